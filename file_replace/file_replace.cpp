@@ -1,59 +1,11 @@
+#include <algorithm>
 #include <functional>
 #include <fstream>
 #include <iostream>
-#include <regex>
 
+#include "find_all.hpp"
 #include "memory_mapped_file.hpp"
 
-struct match
-{
-	size_t begin = 0;
-	size_t end = 0;
-};
-
-std::vector<match> find_all_plain(std::string_view haystack, std::string_view needle)
-{
-	std::vector<match> result;
-
-	auto searcher = std::boyer_moore_horspool_searcher(needle.cbegin(), needle.cend());
-
-	auto it = std::search(haystack.cbegin(), haystack.cend(), searcher);
-
-	while (it != haystack.cend())
-	{
-		auto match_begin = it - haystack.cbegin();
-		auto match_end = match_begin + needle.size();
-		result.emplace_back(match_begin, match_end);
-
-		it = std::search(it + needle.size(), haystack.cend(), searcher);
-	}
-
-	return result;
-}
-
-std::vector<match> find_all_regex(std::string_view haystack, const std::string& needle)
-{
-	std::vector<match> result;
-
-	const std::regex regex(needle, std::regex::grep);
-
-	std::regex_token_iterator<std::string_view::iterator> it(haystack.cbegin(), haystack.cend(), regex);
-	const std::regex_token_iterator<std::string_view::iterator> end;
-
-	while (it != end)
-	{
-		const std::sub_match match = *it;
-
-		auto match_begin = match.first - haystack.cbegin();
-		auto match_end =  match_begin + match.length();
-		result.emplace_back(match_begin, match_end);
-
-		++it;
-	}
-
-	return result;
-}
-
 size_t replace_all(
 		const std::filesystem::path& file_path,
 		std::function<std::vector<match>(std::string_view)> search_function,
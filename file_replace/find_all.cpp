@@ -0,0 +1,326 @@
+#include "find_all.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <regex>
+#include <thread>
+
+namespace
+{
+	using plain_searcher = std::boyer_moore_horspool_searcher<std::string_view::const_iterator>;
+
+	// The first match starting at or after the offset and before the end
+	std::optional<match> find_next_plain(
+			std::string_view haystack,
+			std::string_view needle,
+			const plain_searcher& searcher,
+			size_t offset,
+			size_t end)
+	{
+		if (offset >= end)
+		{
+			return {};
+		}
+
+		// A match starting before the end reaches up to needle size - 1 bytes past it
+		const auto last = haystack.cbegin() + std::min(end + needle.size() - 1, haystack.size());
+		const auto it = std::search(haystack.cbegin() + offset, last, searcher);
+
+		if (it == last)
+		{
+			return {};
+		}
+
+		const auto match_begin = static_cast<size_t>(it - haystack.cbegin());
+		return match{ match_begin, match_begin + needle.size() };
+	}
+
+	// The matches starting at or after the begin and before the end, as a
+	// search starting at the begin finds them
+	void find_plain_range(
+			std::string_view haystack,
+			std::string_view needle,
+			const plain_searcher& searcher,
+			size_t begin,
+			size_t end,
+			std::vector<match>& result)
+	{
+		for (auto found = find_next_plain(haystack, needle, searcher, begin, end); found;
+			found = find_next_plain(haystack, needle, searcher, found->end, end))
+		{
+			result.push_back(*found);
+		}
+	}
+
+	constexpr size_t no_merge = SIZE_MAX;
+
+	// The search of the whole haystack enters a chunk at the end of the last
+	// match of the previous chunks, at most needle size - 1 bytes past the
+	// beginning of the chunk. Every such offset leads to the first match at or
+	// after it, so the chunk has as many entries as matches start within those
+	// bytes, plus the one after them.
+	struct chunk_entry
+	{
+		// The first offset leading to the entry and the match it leads to
+		size_t offset = 0;
+		std::optional<match> first;
+
+		// The match of the chunk's own search the entry's matches meet, if any
+		size_t merge_index = no_merge;
+
+		// The matches from the entry on and the end of the last one
+		size_t count = 0;
+		size_t last_end = 0;
+	};
+
+	struct chunk_matches
+	{
+		// Found by a search starting at the beginning of the chunk
+		std::vector<match> own;
+		std::vector<chunk_entry> entries;
+	};
+
+	// Searches the chunk from its beginning, then follows the matches from
+	// every other entry until they meet those, only counting them
+	void find_chunk_entries(
+			std::string_view haystack,
+			std::string_view needle,
+			const plain_searcher& searcher,
+			size_t begin,
+			size_t end,
+			size_t last_entry,
+			chunk_matches& result)
+	{
+		find_plain_range(haystack, needle, searcher, begin, end, result.own);
+
+		const std::vector<match>& own = result.own;
+
+		for (size_t offset = begin; offset <= last_entry;)
+		{
+			chunk_entry entry;
+			entry.offset = offset;
+
+			// The beginning leads to the first of the chunk's own matches
+			if (offset == begin)
+			{
+				if (!own.empty())
+				{
+					entry.first = own.front();
+				}
+			}
+			else
+			{
+				entry.first = find_next_plain(haystack, needle, searcher, offset, end);
+			}
+
+			if (!entry.first)
+			{
+				result.entries.push_back(entry);
+				break;
+			}
+
+			size_t cursor = 0;
+
+			for (auto next = entry.first; next; next = find_next_plain(haystack, needle, searcher, next->end, end))
+			{
+				while (cursor < own.size() && own[cursor].begin < next->begin)
+				{
+					++cursor;
+				}
+
+				if (cursor < own.size() && own[cursor].begin == next->begin)
+				{
+					entry.merge_index = cursor;
+					entry.count += own.size() - cursor;
+					entry.last_end = own.back().end;
+					break;
+				}
+
+				++entry.count;
+				entry.last_end = next->end;
+			}
+
+			offset = entry.first->begin + 1;
+			result.entries.push_back(entry);
+		}
+	}
+
+	// Writes the matches of the chunk from the entry on
+	void copy_chunk_matches(
+			std::string_view haystack,
+			std::string_view needle,
+			const plain_searcher& searcher,
+			size_t end,
+			const chunk_matches& chunk,
+			const chunk_entry& entry,
+			match* out)
+	{
+		const size_t merge_begin = entry.merge_index == no_merge ? end : chunk.own[entry.merge_index].begin;
+		auto next = entry.first;
+
+		// Until the matches meet those of the chunk's own search they are searched again
+		for (; next && next->begin < merge_begin; next = find_next_plain(haystack, needle, searcher, next->end, end))
+		{
+			*out++ = *next;
+		}
+
+		if (entry.merge_index != no_merge)
+		{
+			std::copy(chunk.own.cbegin() + static_cast<ptrdiff_t>(entry.merge_index), chunk.own.cend(), out);
+		}
+	}
+}
+
+std::vector<match> find_all_plain(std::string_view haystack, std::string_view needle)
+{
+	constexpr size_t min_chunk_size = 0x1000000; // 16 MiB
+
+	const size_t chunk_count = std::min<size_t>(
+		std::max(std::thread::hardware_concurrency(), 1u),
+		haystack.size() / min_chunk_size);
+
+	return find_all_plain_chunked(haystack, needle, chunk_count);
+}
+
+// Each chunk is searched on its own thread, from its own beginning and from
+// every other entry the search of the whole haystack may have into it. A
+// needle overlapping itself may have up to needle size of them, which mostly
+// meet the chunk's own matches within a match or two. The entries are then
+// picked in order, the previous chunk telling where the next one is entered,
+// and each chunk writes its matches from the entry on its own thread again.
+// The result is the very list a single pass finds.
+std::vector<match> find_all_plain_chunked(
+	std::string_view haystack,
+	std::string_view needle,
+	size_t chunk_count,
+	std::vector<size_t>* chunk_match_counts)
+{
+	std::vector<match> result;
+
+	const plain_searcher searcher(needle.cbegin(), needle.cend());
+
+	if (needle.empty() || chunk_count < 2)
+	{
+		find_plain_range(haystack, needle, searcher, 0, haystack.size(), result);
+
+		if (chunk_match_counts)
+		{
+			chunk_match_counts->assign(1, result.size());
+		}
+
+		return result;
+	}
+
+	const auto chunk_begin = [&](size_t chunk)
+	{
+		return haystack.size() * chunk / chunk_count;
+	};
+
+	// Runs the task for every chunk, the first one on the calling thread
+	const auto for_each_chunk = [chunk_count](const std::function<void(size_t)>& task)
+	{
+		std::vector<std::thread> threads;
+
+		for (size_t i = 1; i < chunk_count; ++i)
+		{
+			threads.emplace_back(task, i);
+		}
+
+		task(0);
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	};
+
+	std::vector<chunk_matches> chunks(chunk_count);
+
+	for_each_chunk([&](size_t i)
+	{
+		const size_t begin = chunk_begin(i);
+		const size_t last_entry = i ? begin + needle.size() - 1 : begin;
+		find_chunk_entries(haystack, needle, searcher, begin, chunk_begin(i + 1), last_entry, chunks[i]);
+	});
+
+	// The entry of each chunk and where its matches go in the result
+	std::vector<const chunk_entry*> entries(chunk_count, nullptr);
+	std::vector<size_t> positions(chunk_count, 0);
+	size_t count = 0;
+	size_t last_end = 0;
+
+	for (size_t i = 0; i < chunk_count; ++i)
+	{
+		const std::vector<chunk_entry>& candidates = chunks[i].entries;
+		const size_t offset = std::max(last_end, chunk_begin(i));
+
+		if (offset >= chunk_begin(i + 1))
+		{
+			continue;
+		}
+
+		// The last entry at or before the offset leads to the first match after it
+		const chunk_entry& entry = *std::prev(std::upper_bound(candidates.cbegin(), candidates.cend(), offset,
+			[](size_t offset, const chunk_entry& entry)
+			{
+				return offset < entry.offset;
+			}));
+
+		entries[i] = &entry;
+		positions[i] = count;
+		count += entry.count;
+
+		if (entry.count)
+		{
+			last_end = entry.last_end;
+		}
+	}
+
+	result.resize(count);
+
+	for_each_chunk([&](size_t i)
+	{
+		if (entries[i])
+		{
+			copy_chunk_matches(haystack, needle, searcher, chunk_begin(i + 1), chunks[i], *entries[i], result.data() + positions[i]);
+		}
+	});
+
+	if (chunk_match_counts)
+	{
+		chunk_match_counts->assign(chunk_count, 0);
+
+		for (size_t i = 0; i < chunk_count; ++i)
+		{
+			(*chunk_match_counts)[i] = entries[i] ? entries[i]->count : 0;
+		}
+	}
+
+	return result;
+}
+
+std::vector<match> find_all_regex(std::string_view haystack, const std::string& needle)
+{
+	std::vector<match> result;
+
+	const std::regex regex(needle, std::regex::grep);
+
+	std::regex_token_iterator<std::string_view::iterator> it(haystack.cbegin(), haystack.cend(), regex);
+	const std::regex_token_iterator<std::string_view::iterator> end;
+
+	while (it != end)
+	{
+		const std::sub_match match = *it;
+
+		auto match_begin = match.first - haystack.cbegin();
+		auto match_end =  match_begin + match.length();
+		result.emplace_back(match_begin, match_end);
+
+		++it;
+	}
+
+	return result;
+}
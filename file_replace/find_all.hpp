@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct match
+{
+	size_t begin = 0;
+	size_t end = 0;
+};
+
+// Each match starts after the end of the previous one
+std::vector<match> find_all_plain(std::string_view haystack, std::string_view needle);
+
+// As above, with the haystack cut into the number of chunks searched
+// concurrently, whatever their size. The number of matches of the result
+// each chunk's own search found is stored in the match counts, if given.
+std::vector<match> find_all_plain_chunked(
+	std::string_view haystack,
+	std::string_view needle,
+	size_t chunk_count,
+	std::vector<size_t>* chunk_match_counts = nullptr);
+
+std::vector<match> find_all_regex(std::string_view haystack, const std::string& needle);
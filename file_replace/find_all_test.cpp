@@ -0,0 +1,124 @@
+#include "find_all.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	// A single pass of the standard library, without any chunks
+	std::vector<match> find_all_reference(std::string_view haystack, std::string_view needle)
+	{
+		std::vector<match> result;
+
+		for (size_t offset = haystack.find(needle); offset != std::string_view::npos; offset = haystack.find(needle, offset + needle.size()))
+		{
+			result.push_back({ offset, offset + needle.size() });
+		}
+
+		return result;
+	}
+
+	bool check(std::string_view haystack, std::string_view needle, size_t chunk_count, bool every_chunk_matches = false)
+	{
+		const auto expected = find_all_reference(haystack, needle);
+
+		std::vector<size_t> counts;
+		const auto found = find_all_plain_chunked(haystack, needle, chunk_count, &counts);
+
+		const bool same = std::equal(found.cbegin(), found.cend(), expected.cbegin(), expected.cend(),
+			[](const match& a, const match& b)
+			{
+				return a.begin == b.begin && a.end == b.end;
+			});
+
+		if (!same)
+		{
+			std::cerr << "\"" << needle << "\" in " << haystack.size() << " bytes in " << chunk_count << " chunks: " <<
+				found.size() << " matches, expected " << expected.size() << std::endl;
+
+			return false;
+		}
+
+		// Each chunk's own search found the matches starting within it, none
+		// were left to the merge
+		auto next = found.cbegin();
+
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			const size_t end = haystack.size() * (i + 1) / counts.size();
+			const auto chunk_end = std::find_if(next, found.cend(), [end](const match& m) { return m.begin >= end; });
+			const auto within = static_cast<size_t>(chunk_end - next);
+			next = chunk_end;
+
+			if (counts[i] != within || (every_chunk_matches && !within))
+			{
+				std::cerr << "\"" << needle << "\" in " << haystack.size() << " bytes in " << chunk_count << " chunks: chunk " <<
+					i << " found " << counts[i] << " of its " << within << " matches" << std::endl;
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+int main()
+{
+	bool passed = true;
+
+	// The chunk boundaries fall inside a run of matches of needles overlapping
+	// themselves, whose searches never get back in step. Searching the run
+	// again for every match would not finish, nor would it be split across
+	// the chunks.
+	const std::string run(0x100000, 'a');
+
+	for (std::string_view needle : { "a", "aa", "aaa", "aaaaaaa" })
+	{
+		for (size_t chunk_count : { 2, 3, 4, 7 })
+		{
+			passed &= check(run, needle, chunk_count, true);
+		}
+	}
+
+	std::string periodic;
+	periodic.reserve(5008);
+	periodic += 'x';
+	periodic.append(1001, 'a');
+	periodic += "ab";
+	periodic.append(999, 'a');
+	periodic += "abab";
+	periodic.append(3000, 'a');
+
+	for (size_t chunk_count = 2; chunk_count < 12; ++chunk_count)
+	{
+		passed &= check(periodic, "aaa", chunk_count, true);
+		passed &= check(periodic, "aba", chunk_count);
+	}
+
+	// Short haystacks of a few letters, in more chunks than some needles are long
+	std::mt19937 engine(0x5EED);
+
+	for (size_t i = 0; i < 4000; ++i)
+	{
+		const size_t letters = 1 + engine() % 3;
+
+		std::string haystack(engine() % 200, '\0');
+		std::string needle(1 + engine() % 6, '\0');
+
+		for (char& c : haystack)
+		{
+			c = static_cast<char>('a' + engine() % letters);
+		}
+
+		for (char& c : needle)
+		{
+			c = static_cast<char>('a' + engine() % letters);
+		}
+
+		passed &= check(haystack, needle, 1 + engine() % 16);
+	}
+
+	return passed ? 0 : 1;
+}
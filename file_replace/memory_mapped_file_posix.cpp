@@ -1,5 +1,7 @@
 #include "memory_mapped_file.hpp"
 
+#include <utility>
+
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -14,20 +16,61 @@ using file_status = struct stat;
 constexpr auto file_status_function = fstat;
 #endif
 
+namespace
+{
+	// Closes the descriptor unless it is released, so that a constructor
+	// throwing halfway does not leak it
+	class descriptor_guard
+	{
+	public:
+		explicit descriptor_guard(int descriptor) :
+			_descriptor(descriptor)
+		{
+		}
+
+		~descriptor_guard()
+		{
+			if (_descriptor != -1)
+			{
+				::close(_descriptor);
+			}
+		}
+
+		int get() const
+		{
+			return _descriptor;
+		}
+
+		int release()
+		{
+			return std::exchange(_descriptor, -1);
+		}
+
+	private:
+		descriptor_guard(const descriptor_guard&) = delete;
+		descriptor_guard(descriptor_guard&&) = delete;
+		descriptor_guard& operator = (const descriptor_guard&) = delete;
+		descriptor_guard& operator = (descriptor_guard&&) = delete;
+
+		int _descriptor;
+	};
+}
+
 class memory_mapped_file_impl
 {
 public:
-	memory_mapped_file_impl(const std::filesystem::path& path) :
-		_descriptor(open(path.c_str(), O_RDONLY))
+	memory_mapped_file_impl(const std::filesystem::path& path)
 	{
-		if (_descriptor == -1)
+		descriptor_guard descriptor(open(path.c_str(), O_RDONLY));
+
+		if (descriptor.get() == -1)
 		{
 			throw std::system_error(errno, std::system_category(), "open");
 		}
 
 		file_status status;
 
-		if (file_status_function(_descriptor, &status) == -1)
+		if (file_status_function(descriptor.get(), &status) == -1)
 		{
 			throw std::system_error(errno, std::system_category(), "fstat");
 		}
@@ -39,12 +82,18 @@ public:
 
 		_size = status.st_size;
 
-		_view = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _descriptor, 0);
-
-		if (_view == MAP_FAILED)
+		// Mapping zero bytes is an error, an empty file is just an empty view
+		if (_size)
 		{
-			throw std::system_error(errno, std::system_category(), "mmap");
+			_view = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, descriptor.get(), 0);
+
+			if (_view == MAP_FAILED)
+			{
+				throw std::system_error(errno, std::system_category(), "mmap");
+			}
 		}
+
+		_descriptor = descriptor.release();
 	}
 
 	~memory_mapped_file_impl()
@@ -74,6 +123,7 @@ public:
 				throw std::system_error(errno, std::system_category(), "munmap");
 			}
 
+			_view = nullptr;
 			_size = 0;
 		}
 
@@ -1,53 +1,104 @@
 #include "memory_mapped_file.hpp"
 
+#include <utility>
+
 #include <Windows.h>
 
+namespace
+{
+	// Closes the handle unless it is released, so that a constructor throwing
+	// halfway does not leak it
+	class handle_guard
+	{
+	public:
+		explicit handle_guard(HANDLE handle) :
+			_handle(handle)
+		{
+		}
+
+		~handle_guard()
+		{
+			if (_handle && _handle != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(_handle);
+			}
+		}
+
+		HANDLE get() const
+		{
+			return _handle;
+		}
+
+		HANDLE release()
+		{
+			return std::exchange(_handle, nullptr);
+		}
+
+	private:
+		handle_guard(const handle_guard&) = delete;
+		handle_guard(handle_guard&&) = delete;
+		handle_guard& operator = (const handle_guard&) = delete;
+		handle_guard& operator = (handle_guard&&) = delete;
+
+		HANDLE _handle;
+	};
+}
+
 class memory_mapped_file_impl
 {
 public:
-	memory_mapped_file_impl(const std::filesystem::path& path) :
-		_file(CreateFileW(
+	memory_mapped_file_impl(const std::filesystem::path& path)
+	{
+		handle_guard file(CreateFileW(
 			path.c_str(),
 			GENERIC_READ,
 			FILE_SHARE_READ,
 			nullptr,
 			OPEN_EXISTING,
 			FILE_ATTRIBUTE_NORMAL,
-			NULL))
-	{
-		if (_file == nullptr || _file == INVALID_HANDLE_VALUE)
+			NULL));
+
+		if (file.get() == nullptr || file.get() == INVALID_HANDLE_VALUE)
 		{
 			throw std::system_error(GetLastError(), std::system_category(), "CreateFileW");
 		}
 
 		LARGE_INTEGER mapping_size;
 
-		if (!GetFileSizeEx(_file, &mapping_size))
+		if (!GetFileSizeEx(file.get(), &mapping_size))
 		{
 			throw std::system_error(GetLastError(), std::system_category(), "GetFileSizeEx");
 		}
 
 		_size = mapping_size.QuadPart;
 
-		_mapping = CreateFileMappingW(
-			_file,
-			nullptr,
-			PAGE_READWRITE,
-			mapping_size.HighPart,
-			mapping_size.LowPart,
-			nullptr);
-
-		if (!_mapping)
+		// Mapping zero bytes is an error, an empty file is just an empty view
+		if (_size)
 		{
-			throw std::system_error(GetLastError(), std::system_category(), "CreateFileMappingW");
-		}
+			handle_guard mapping(CreateFileMappingW(
+				file.get(),
+				nullptr,
+				PAGE_READONLY,
+				mapping_size.HighPart,
+				mapping_size.LowPart,
+				nullptr));
+
+			if (!mapping.get())
+			{
+				throw std::system_error(GetLastError(), std::system_category(), "CreateFileMappingW");
+			}
 
-		_view = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, _size);
+			_view = MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, _size);
 
-		if (!_view)
-		{
-			throw std::system_error(GetLastError(), std::system_category(), "MapViewOfFile");
+			if (!_view)
+			{
+				throw std::system_error(GetLastError(), std::system_category(), "MapViewOfFile");
+			}
+
+			_mapping = mapping.release();
 		}
+
+		_file = file.release();
 	}
 
 	~memory_mapped_file_impl()
@@ -0,0 +1,195 @@
+#include "aho_corasick.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	constexpr size_t dense_memory_budget = 0x1000000; // 16 MiB of dense rows
+
+	struct trie_node
+	{
+		std::vector<std::pair<uint8_t, uint32_t>> children;
+		uint32_t pattern = UINT32_MAX;
+	};
+}
+
+aho_corasick::aho_corasick(const std::vector<std::string>& patterns) :
+	_patterns(patterns)
+{
+	std::array<bool, 256> used = {};
+
+	for (const std::string& pattern : _patterns)
+	{
+		for (char c : pattern)
+		{
+			used[static_cast<uint8_t>(c)] = true;
+		}
+	}
+
+	// The bytes no pattern uses share the class zero, if there are any
+	const bool any_unused = std::find(used.cbegin(), used.cend(), false) != used.cend();
+	_class_count = any_unused ? 1 : 0;
+
+	for (size_t c = 0; c < 256; ++c)
+	{
+		if (used[c])
+		{
+			_classes[c] = static_cast<uint8_t>(_class_count++);
+		}
+	}
+
+	std::vector<trie_node> trie(1);
+
+	for (size_t i = 0; i < _patterns.size(); ++i)
+	{
+		if (_patterns[i].empty())
+		{
+			continue;
+		}
+
+		uint32_t state = 0;
+
+		for (char c : _patterns[i])
+		{
+			const uint8_t byte_class = _classes[static_cast<uint8_t>(c)];
+			auto& children = trie[state].children;
+
+			const auto iter = std::find_if(children.cbegin(), children.cend(), [&](const auto& child)
+			{
+				return child.first == byte_class;
+			});
+
+			if (iter != children.cend())
+			{
+				state = iter->second;
+				continue;
+			}
+
+			const uint32_t child = static_cast<uint32_t>(trie.size());
+			trie[state].children.emplace_back(byte_class, child);
+			trie.emplace_back();
+			state = child;
+		}
+
+		if (trie[state].pattern == no_pattern)
+		{
+			trie[state].pattern = static_cast<uint32_t>(i);
+		}
+	}
+
+	// Number the states breadth first, so the shallow ones come first and
+	// every failure link points to a smaller number
+	std::vector<uint32_t> order = { 0 };
+	std::vector<uint32_t> renumbered(trie.size());
+
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		auto& children = trie[order[i]].children;
+		std::sort(children.begin(), children.end());
+
+		for (const auto& child : children)
+		{
+			renumbered[child.second] = static_cast<uint32_t>(order.size());
+			order.push_back(child.second);
+		}
+	}
+
+	const size_t state_count = trie.size();
+
+	_edge_offsets.reserve(state_count + 1);
+	_edge_classes.reserve(state_count);
+	_edge_targets.reserve(state_count);
+
+	for (uint32_t original : order)
+	{
+		_edge_offsets.push_back(static_cast<uint32_t>(_edge_targets.size()));
+
+		for (const auto& [byte_class, child] : trie[original].children)
+		{
+			_edge_classes.push_back(byte_class);
+			_edge_targets.push_back(renumbered[child]);
+		}
+	}
+
+	_edge_offsets.push_back(static_cast<uint32_t>(_edge_targets.size()));
+
+	_dense_count = std::clamp(dense_memory_budget / (_class_count * sizeof(uint32_t)), size_t(1), state_count);
+	_dense.assign(_dense_count * _class_count, 0);
+	_failures.assign(state_count, 0);
+	_outputs.assign(state_count, no_pattern);
+
+	for (uint32_t state = 0; state < state_count; ++state)
+	{
+		const uint32_t failure = _failures[state];
+		const uint32_t pattern = trie[order[state]].pattern;
+
+		_outputs[state] = pattern != no_pattern || !state ? pattern : _outputs[failure];
+
+		if (state < _dense_count)
+		{
+			uint32_t* row = &_dense[state * _class_count];
+
+			if (state)
+			{
+				std::copy_n(&_dense[failure * _class_count], _class_count, row);
+			}
+
+			for (uint32_t i = _edge_offsets[state]; i < _edge_offsets[state + 1]; ++i)
+			{
+				row[_edge_classes[i]] = _edge_targets[i];
+			}
+		}
+
+		for (uint32_t i = _edge_offsets[state]; i < _edge_offsets[state + 1]; ++i)
+		{
+			_failures[_edge_targets[i]] = state ? next(failure, _edge_classes[i]) : 0;
+		}
+	}
+}
+
+std::optional<aho_corasick::match> aho_corasick::find(std::string_view text, size_t offset) const
+{
+	uint32_t state = 0;
+
+	for (size_t i = offset; i < text.size(); ++i)
+	{
+		const uint8_t byte_class = _classes[static_cast<uint8_t>(text[i])];
+
+		state = state < _dense_count ?
+			_dense[state * _class_count + byte_class] :
+			next(state, byte_class);
+
+		const uint32_t output = _outputs[state];
+
+		if (output != no_pattern)
+		{
+			return match { i + 1 - _patterns[output].size(), i + 1, output };
+		}
+	}
+
+	return std::nullopt;
+}
+
+std::string_view aho_corasick::pattern(uint32_t index) const
+{
+	return _patterns[index];
+}
+
+uint32_t aho_corasick::next(uint32_t state, uint8_t byte_class) const
+{
+	while (state >= _dense_count)
+	{
+		const auto begin = _edge_classes.cbegin() + _edge_offsets[state];
+		const auto end = _edge_classes.cbegin() + _edge_offsets[state + 1];
+		const auto iter = std::lower_bound(begin, end, byte_class);
+
+		if (iter != end && *iter == byte_class)
+		{
+			return _edge_targets[iter - _edge_classes.cbegin()];
+		}
+
+		state = _failures[state];
+	}
+
+	return _dense[state * _class_count + byte_class];
+}
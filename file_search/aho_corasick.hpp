@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Finds any of many patterns in one pass. The automaton is stored over byte
+// classes, the bytes that occur in no pattern share one class. The states
+// closest to the root, which a scan spends nearly all of its time in, get
+// a dense transition table; deeper states keep sorted edge lists and fall
+// back along their failure links.
+class aho_corasick
+{
+public:
+	struct match
+	{
+		size_t begin = 0;
+		size_t end = 0;
+		uint32_t pattern = 0;
+	};
+
+	explicit aho_corasick(const std::vector<std::string>& patterns);
+
+	// The first match ending at or after the offset, starting from the root
+	std::optional<match> find(std::string_view text, size_t offset = 0) const;
+
+	std::string_view pattern(uint32_t index) const;
+
+private:
+	static constexpr uint32_t no_pattern = UINT32_MAX;
+
+	uint32_t next(uint32_t state, uint8_t byte_class) const;
+
+	std::vector<std::string> _patterns;
+
+	std::array<uint8_t, 256> _classes = {};
+	size_t _class_count = 1;
+
+	// Dense rows of the shallowest states
+	size_t _dense_count = 0;
+	std::vector<uint32_t> _dense;
+
+	// Sorted edges of the other states, indexed by state
+	std::vector<uint32_t> _edge_offsets;
+	std::vector<uint8_t> _edge_classes;
+	std::vector<uint32_t> _edge_targets;
+
+	std::vector<uint32_t> _failures;
+
+	// The pattern ending at each state, the longest one reachable by failure links
+	std::vector<uint32_t> _outputs;
+};
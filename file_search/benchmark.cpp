@@ -0,0 +1,320 @@
+#include "grep_regex.hpp"
+#include "plain_search.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+
+namespace
+{
+	constexpr size_t repeats = 5;
+
+	// Log-like lines built from a small vocabulary, the interesting words are rare
+	std::string text_corpus(size_t size)
+	{
+		constexpr std::array<std::string_view, 16> words =
+		{
+			"INFO", "DEBUG", "worker", "request", "completed", "in", "ms", "user",
+			"session", "GET", "/api/v1/items", "200", "cache", "hit", "miss", "queue"
+		};
+
+		std::mt19937_64 engine(0x5EED);
+		std::uniform_int_distribution<size_t> word_distribution(0, words.size() - 1);
+		std::uniform_int_distribution<size_t> length_distribution(4, 20);
+		std::uniform_int_distribution<size_t> rare_distribution(0, 9999);
+
+		std::string corpus;
+		corpus.reserve(size + 0x100);
+
+		while (corpus.size() < size)
+		{
+			corpus += "2026-10-17T12:00:00 ";
+
+			for (size_t i = length_distribution(engine); i; --i)
+			{
+				corpus += words[word_distribution(engine)];
+				corpus += ' ';
+			}
+
+			if (rare_distribution(engine) == 0)
+			{
+				corpus += "ERROR connection timeout";
+			}
+
+			corpus += '\n';
+		}
+
+		return corpus;
+	}
+
+	std::string binary_corpus(size_t size)
+	{
+		std::mt19937_64 engine(0xB17E);
+		std::string corpus(size, '\0');
+
+		for (char& c : corpus)
+		{
+			c = static_cast<char>(engine());
+		}
+
+		return corpus;
+	}
+
+	template <typename F>
+	std::pair<size_t, double> measure(F&& find_all)
+	{
+		size_t count = 0;
+		double best = std::numeric_limits<double>::max();
+
+		for (size_t i = 0; i < repeats; ++i)
+		{
+			const auto begin = std::chrono::steady_clock::now();
+			count = find_all();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+			best = std::min(best, elapsed.count());
+		}
+
+		return { count, best };
+	}
+
+	template <typename F>
+	size_t count_all(std::string_view corpus, size_t needle_size, F&& find)
+	{
+		size_t count = 0;
+
+		for (size_t position = find(corpus, 0); position != std::string_view::npos; position = find(corpus, position + needle_size))
+		{
+			++count;
+		}
+
+		return count;
+	}
+
+	void report(std::string_view corpus_name, std::string_view method, std::string_view expression, size_t bytes, const std::pair<size_t, double>& result)
+	{
+		const double gigabytes_per_second = static_cast<double>(bytes) / result.second / 1e9;
+
+		std::cout << std::left
+			<< std::setw(8) << corpus_name
+			<< std::setw(20) << method
+			<< std::setw(28) << ('"' + std::string(expression) + '"')
+			<< std::right
+			<< std::setw(10) << result.first
+			<< std::setw(12) << std::fixed << std::setprecision(3) << result.second * 1000 << " ms"
+			<< std::setw(10) << std::setprecision(2) << gigabytes_per_second << " GB/s" << std::endl;
+	}
+
+	void benchmark_plain(std::string_view corpus_name, std::string_view corpus)
+	{
+		constexpr std::array<std::string_view, 5> needles =
+		{
+			"timeout", "ERROR connection timeout", "session", "not present at all", "zq"
+		};
+
+		for (std::string_view needle : needles)
+		{
+			const auto find = measure([&]()
+			{
+				return count_all(corpus, needle.size(), [&](std::string_view haystack, size_t offset)
+				{
+					return haystack.find(needle, offset);
+				});
+			});
+
+			const plain_searcher searcher(needle);
+
+			const auto kernel = measure([&]()
+			{
+				return count_all(corpus, needle.size(), [&](std::string_view haystack, size_t offset)
+				{
+					return searcher.find(haystack, offset);
+				});
+			});
+
+			if (find.first != kernel.first)
+			{
+				std::cerr << "Mismatch for \"" << needle << "\": " << find.first << " vs. " << kernel.first << std::endl;
+			}
+
+			report(corpus_name, "string_view::find", needle, corpus.size(), find);
+			report(corpus_name, plain_searcher::kernel_name(), needle, corpus.size(), kernel);
+		}
+	}
+
+	// Against a search with a case folding comparison, as std::regex::icase
+	// would do it
+	void benchmark_plain_ignoring_case(std::string_view corpus_name, std::string_view corpus)
+	{
+		constexpr std::array<std::string_view, 4> needles =
+		{
+			"Timeout", "error CONNECTION timeout", "Session", "not present at all"
+		};
+
+		const auto equal_ignoring_case = [](char a, char b)
+		{
+			return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+		};
+
+		for (std::string_view needle : needles)
+		{
+			const auto search = measure([&]()
+			{
+				return count_all(corpus, needle.size(), [&](std::string_view haystack, size_t offset)
+				{
+					const auto iter = std::search(haystack.cbegin() + offset, haystack.cend(), needle.cbegin(), needle.cend(), equal_ignoring_case);
+					return iter == haystack.cend() ? std::string_view::npos : static_cast<size_t>(iter - haystack.cbegin());
+				});
+			});
+
+			const plain_searcher searcher(needle, true);
+
+			const auto kernel = measure([&]()
+			{
+				return count_all(corpus, needle.size(), [&](std::string_view haystack, size_t offset)
+				{
+					return searcher.find(haystack, offset);
+				});
+			});
+
+			if (search.first != kernel.first)
+			{
+				std::cerr << "Mismatch for \"" << needle << "\": " << search.first << " vs. " << kernel.first << std::endl;
+			}
+
+			report(corpus_name, "std::search icase", needle, corpus.size(), search);
+			report(corpus_name, std::string(plain_searcher::kernel_name()) + " icase", needle, corpus.size(), kernel);
+		}
+	}
+
+	template <typename F>
+	size_t count_lines(std::string_view corpus, F&& is_match)
+	{
+		size_t count = 0;
+
+		for (size_t offset = 0; offset < corpus.size();)
+		{
+			const size_t line_end = std::min(corpus.find('\n', offset), corpus.size());
+
+			if (is_match(corpus.substr(offset, line_end - offset)))
+			{
+				++count;
+			}
+
+			offset = line_end + 1;
+		}
+
+		return count;
+	}
+
+	void benchmark_regex(std::string_view corpus_name, std::string_view corpus)
+	{
+		constexpr std::array<std::string_view, 5> expressions =
+		{
+			"ERROR.*timeout",
+			"[0-9]\\{3\\} cache",
+			"session.*miss.*queue",
+			"^2026-10-17T12:00:00 GET",
+			"worker [hm]i[st]\\{1,2\\}"
+		};
+
+		for (std::string_view expression : expressions)
+		{
+			const std::regex regex(expression.cbegin(), expression.cend(), std::regex::grep | std::regex::icase);
+
+			const auto standard = measure([&]()
+			{
+				return count_lines(corpus, [&](std::string_view line)
+				{
+					return std::regex_search(line.cbegin(), line.cend(), regex);
+				});
+			});
+
+			const grep_regex automaton(expression, true);
+
+			const auto lazy_dfa = measure([&]()
+			{
+				return count_lines(corpus, [&](std::string_view line)
+				{
+					return automaton.search(line);
+				});
+			});
+
+			if (standard.first != lazy_dfa.first)
+			{
+				std::cerr << "Mismatch for \"" << expression << "\": " << standard.first << " vs. " << lazy_dfa.first << std::endl;
+			}
+
+			report(corpus_name, "std::regex", expression, corpus.size(), standard);
+			report(corpus_name, "grep_regex", expression, corpus.size(), lazy_dfa);
+		}
+	}
+
+	// A nested star makes a backtracking engine try exponentially many ways to
+	// split the line, the automaton reads every byte once.
+	void benchmark_pathological()
+	{
+		constexpr std::string_view expression = "\\(a*\\)*b";
+		const std::regex regex(expression.cbegin(), expression.cend(), std::regex::grep);
+		const grep_regex automaton(expression, false);
+
+		for (size_t length = 8; length <= 14; length += 2)
+		{
+			const std::string line(length, 'a');
+
+			const auto standard = measure([&]()
+			{
+				return size_t(std::regex_search(line, regex));
+			});
+
+			const auto lazy_dfa = measure([&]()
+			{
+				return size_t(automaton.search(line));
+			});
+
+			report("a^" + std::to_string(length), "std::regex", expression, line.size(), standard);
+			report("a^" + std::to_string(length), "grep_regex", expression, line.size(), lazy_dfa);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t megabytes = 256;
+
+	if (argc > 1)
+	{
+		const std::string_view value(argv[1]);
+		const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), megabytes);
+
+		if (error != std::errc() || !megabytes)
+		{
+			std::cout << "Usage: " << argv[0] << " [corpus size in MiB]" << std::endl;
+			return EINVAL;
+		}
+	}
+
+	const size_t size = megabytes << 20;
+	const std::string text = text_corpus(size);
+	const std::string binary = binary_corpus(size);
+
+	benchmark_plain("text", text);
+	benchmark_plain("binary", binary);
+	benchmark_plain_ignoring_case("text", text);
+	benchmark_plain_ignoring_case("binary", binary);
+
+	// std::regex is slow enough to test with a fraction of the corpus
+	benchmark_regex("text", std::string_view(text).substr(0, text.size() / 8));
+	benchmark_pathological();
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "content_type.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+	constexpr size_t sample_size = 0x2000;
+
+	// Text in a legacy single byte encoding has an invalid byte here and
+	// there, binary data has them all over
+	constexpr size_t max_invalid_per_mille = 100;
+
+	// The length of the UTF-8 sequence starting at the position, or zero if
+	// it is invalid. A sequence cut off by the end of the sample is valid.
+	size_t sequence_length(std::string_view sample, size_t position)
+	{
+		const uint8_t lead = static_cast<uint8_t>(sample[position]);
+		size_t length = 0;
+
+		if (lead < 0x80)
+		{
+			return 1;
+		}
+		else if (lead >= 0xC2 && lead <= 0xDF)
+		{
+			length = 2;
+		}
+		else if (lead >= 0xE0 && lead <= 0xEF)
+		{
+			length = 3;
+		}
+		else if (lead >= 0xF0 && lead <= 0xF4)
+		{
+			length = 4;
+		}
+		else
+		{
+			return 0;
+		}
+
+		const size_t available = std::min(length, sample.size() - position);
+
+		for (size_t i = 1; i < available; ++i)
+		{
+			if ((static_cast<uint8_t>(sample[position + i]) & 0xC0) != 0x80)
+			{
+				return 0;
+			}
+		}
+
+		return available;
+	}
+}
+
+bool looks_binary(std::string_view contents)
+{
+	const std::string_view sample = contents.substr(0, sample_size);
+
+	if (sample.find('\0') != std::string_view::npos)
+	{
+		return true;
+	}
+
+	size_t invalid = 0;
+
+	for (size_t position = 0; position < sample.size();)
+	{
+		const size_t length = sequence_length(sample, position);
+
+		if (length)
+		{
+			position += length;
+		}
+		else
+		{
+			++invalid;
+			++position;
+		}
+	}
+
+	return invalid * 1000 > sample.size() * max_invalid_per_mille;
+}
+
+bool has_utf16_bom(std::string_view contents)
+{
+	return contents.size() >= 2 && contents[0] == '\xFF' && contents[1] == '\xFE';
+}
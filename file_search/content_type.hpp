@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string_view>
+
+// Whether the contents look like anything but text, judging by their first
+// block alone: a NUL byte or too many bytes that are not valid UTF-8 in it.
+// A mapped file is only faulted in as far as that block.
+bool looks_binary(std::string_view contents);
+
+// Whether the contents start with the byte order mark of UTF-16LE, which makes
+// them text whatever NUL bytes follow
+bool has_utf16_bom(std::string_view contents);
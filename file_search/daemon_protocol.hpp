@@ -0,0 +1,57 @@
+#pragma once
+
+#include "output_writer.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// The wire format between the search daemon and its clients, over a Unix
+// domain stream socket. A client sends a single query and reads the response
+// until the daemon closes the connection.
+//
+// A query is a header of 20 bytes, a magic, the mode, the flags, the report,
+// the context and the size of the expression, followed by the expression. The
+// response is a status byte, an errno value, followed by the results written
+// as on the command line or, when the status is not zero, an error message.
+struct daemon_query
+{
+	enum class search_mode : uint8_t
+	{
+		plain,
+		regex
+	};
+
+	search_mode mode = search_mode::plain;
+	bool ignore_case = false;
+	bool search_binary = false;
+	output_writer::report report = output_writer::report::lines;
+	uint32_t before_context = 0;
+	uint32_t after_context = 0;
+	std::string expression;
+};
+
+// Longer expressions are refused
+constexpr size_t max_expression_size = 0x10000; // 64 KiB
+
+// Binds and listens at the path, replacing whatever socket was left there
+int listen_at(const std::filesystem::path& path);
+
+// Accepts a client at the listening socket, -1 if none. Reading its query
+// and writing to it give up after a few seconds of waiting, so a client that
+// stalls does not hold up the ones after it.
+int accept_client(int listener);
+
+int connect_to(const std::filesystem::path& path);
+
+// Both throw if the socket fails
+void send_query(int socket, const daemon_query& query);
+void send_status(int socket, uint8_t status, std::string_view message = {});
+
+// False if the peer sent anything but a query, or not in time
+bool receive_query(int socket, daemon_query& query);
+
+// Copies the response to the standard output, or its error message to the
+// standard error, and returns the status
+uint8_t receive_response(int socket);
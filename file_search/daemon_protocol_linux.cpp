@@ -0,0 +1,288 @@
+#include "daemon_protocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+	constexpr char query_magic[4] = { 'F', 'S', 'Q', '1' };
+
+	enum query_flags : uint8_t
+	{
+		ignore_case_flag = 0x01,
+		search_binary_flag = 0x02
+	};
+
+	struct query_header
+	{
+		char magic[4];
+		uint8_t mode;
+		uint8_t flags;
+		uint8_t report;
+		uint8_t unused;
+		uint32_t before_context;
+		uint32_t after_context;
+		uint32_t expression_size;
+	};
+
+	static_assert(sizeof(query_header) == 20);
+
+	// How long a client may keep the daemon waiting for its query, and for
+	// room to write its results to
+	constexpr timeval receive_timeout = { 5, 0 };
+	constexpr timeval send_timeout = { 10, 0 };
+
+	sockaddr_un socket_address(const std::filesystem::path& path)
+	{
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+
+		if (path.native().size() >= sizeof(address.sun_path))
+		{
+			throw std::system_error(ENAMETOOLONG, std::system_category(), path.string());
+		}
+
+		std::memcpy(address.sun_path, path.c_str(), path.native().size());
+		return address;
+	}
+
+	void write_all(int socket, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+
+		while (size)
+		{
+			const ssize_t written = send(socket, bytes, size, MSG_NOSIGNAL);
+
+			if (written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				throw std::system_error(errno, std::system_category(), "send failed");
+			}
+
+			bytes += written;
+			size -= static_cast<size_t>(written);
+		}
+	}
+
+	// False if the peer closed the connection first or let the socket time out
+	bool read_all(int socket, void* data, size_t size)
+	{
+		char* bytes = static_cast<char*>(data);
+
+		while (size)
+		{
+			const ssize_t count = recv(socket, bytes, size, 0);
+
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					return false;
+				}
+
+				throw std::system_error(errno, std::system_category(), "recv failed");
+			}
+
+			if (!count)
+			{
+				return false;
+			}
+
+			bytes += count;
+			size -= static_cast<size_t>(count);
+		}
+
+		return true;
+	}
+
+	// Writes everything read from the socket to the descriptor
+	void copy_to(int socket, int descriptor)
+	{
+		char buffer[0x10000];
+
+		for (;;)
+		{
+			const ssize_t count = recv(socket, buffer, sizeof(buffer), 0);
+
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				throw std::system_error(errno, std::system_category(), "recv failed");
+			}
+
+			if (!count)
+			{
+				return;
+			}
+
+			for (ssize_t offset = 0; offset < count;)
+			{
+				const ssize_t written = write(descriptor, buffer + offset, static_cast<size_t>(count - offset));
+
+				if (written < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					throw std::system_error(errno, std::system_category(), "write failed");
+				}
+
+				offset += written;
+			}
+		}
+	}
+}
+
+int listen_at(const std::filesystem::path& path)
+{
+	const sockaddr_un address = socket_address(path);
+	const int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (socket == -1)
+	{
+		throw std::system_error(errno, std::system_category(), "socket failed");
+	}
+
+	// A daemon that did not get to clean up leaves its socket behind
+	unlink(path.c_str());
+
+	if (bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1 ||
+		listen(socket, SOMAXCONN) == -1)
+	{
+		const int error = errno;
+		close(socket);
+		throw std::system_error(error, std::system_category(), path.string());
+	}
+
+	return socket;
+}
+
+int accept_client(int listener)
+{
+	const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+
+	if (client == -1)
+	{
+		return -1;
+	}
+
+	if (setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout)) == -1 ||
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout)) == -1)
+	{
+		close(client);
+		return -1;
+	}
+
+	return client;
+}
+
+int connect_to(const std::filesystem::path& path)
+{
+	const sockaddr_un address = socket_address(path);
+	const int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (socket == -1)
+	{
+		throw std::system_error(errno, std::system_category(), "socket failed");
+	}
+
+	if (connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1)
+	{
+		const int error = errno;
+		close(socket);
+		throw std::system_error(error, std::system_category(), path.string());
+	}
+
+	return socket;
+}
+
+void send_query(int socket, const daemon_query& query)
+{
+	query_header header = {};
+	std::memcpy(header.magic, query_magic, sizeof(query_magic));
+	header.mode = static_cast<uint8_t>(query.mode);
+	header.flags = static_cast<uint8_t>(
+		(query.ignore_case ? ignore_case_flag : 0) |
+		(query.search_binary ? search_binary_flag : 0));
+	header.report = static_cast<uint8_t>(query.report);
+	header.before_context = query.before_context;
+	header.after_context = query.after_context;
+	header.expression_size = static_cast<uint32_t>(query.expression.size());
+
+	write_all(socket, &header, sizeof(header));
+	write_all(socket, query.expression.data(), query.expression.size());
+}
+
+void send_status(int socket, uint8_t status, std::string_view message)
+{
+	write_all(socket, &status, sizeof(status));
+	write_all(socket, message.data(), message.size());
+}
+
+bool receive_query(int socket, daemon_query& query)
+{
+	query_header header = {};
+
+	if (!read_all(socket, &header, sizeof(header)) ||
+		std::memcmp(header.magic, query_magic, sizeof(query_magic)) ||
+		header.mode > static_cast<uint8_t>(daemon_query::search_mode::regex) ||
+		header.report > static_cast<uint8_t>(output_writer::report::count) ||
+		header.expression_size > max_expression_size)
+	{
+		return false;
+	}
+
+	query.mode = static_cast<daemon_query::search_mode>(header.mode);
+	query.ignore_case = header.flags & ignore_case_flag;
+	query.search_binary = header.flags & search_binary_flag;
+	query.report = static_cast<output_writer::report>(header.report);
+	query.before_context = header.before_context;
+	query.after_context = header.after_context;
+	query.expression.resize(header.expression_size);
+
+	return read_all(socket, query.expression.data(), query.expression.size());
+}
+
+uint8_t receive_response(int socket)
+{
+	uint8_t status = 0;
+
+	if (!read_all(socket, &status, sizeof(status)))
+	{
+		throw std::system_error(ECONNRESET, std::system_category(), "the daemon closed the connection");
+	}
+
+	if (status)
+	{
+		std::cerr.flush();
+		copy_to(socket, STDERR_FILENO);
+		std::cerr << std::endl;
+		return status;
+	}
+
+	copy_to(socket, STDOUT_FILENO);
+	return 0;
+}
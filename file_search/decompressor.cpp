@@ -0,0 +1,355 @@
+#include "decompressor.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+#ifdef FILE_SEARCH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef FILE_SEARCH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+	constexpr uint8_t gzip_magic[] = { 0x1F, 0x8B };
+	constexpr uint8_t zstd_magic[] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+	template <size_t N>
+	bool starts_with(std::string_view contents, const uint8_t (&magic)[N])
+	{
+		return contents.size() >= N && std::equal(magic, magic + N, contents.cbegin(), [](uint8_t m, char c)
+		{
+			return m == static_cast<uint8_t>(c);
+		});
+	}
+
+#ifdef FILE_SEARCH_ZLIB
+	// One gzip member after another, as concatenated files have them. Whatever
+	// follows the last member that is not a member itself is ignored.
+	class gzip_stream
+	{
+	public:
+		explicit gzip_stream(std::string_view contents) :
+			_input(contents)
+		{
+			if (inflateInit2(&_stream, 15 + 16) != Z_OK)
+			{
+				throw std::bad_alloc();
+			}
+		}
+
+		~gzip_stream()
+		{
+			inflateEnd(&_stream);
+		}
+
+		// Returns less than the size only at the end
+		size_t read(char* data, size_t size)
+		{
+			size_t produced = 0;
+
+			while (produced < size && !_done)
+			{
+				refill();
+
+				if (!_stream.avail_in)
+				{
+					throw std::runtime_error("the gzip data is truncated");
+				}
+
+				_stream.next_out = reinterpret_cast<Bytef*>(data + produced);
+				_stream.avail_out = static_cast<uInt>(size - produced);
+
+				const int result = inflate(&_stream, Z_NO_FLUSH);
+				produced = size - _stream.avail_out;
+
+				if (result == Z_STREAM_END)
+				{
+					refill();
+
+					const std::string_view rest(reinterpret_cast<const char*>(_stream.next_in), _stream.avail_in);
+					_done = !starts_with(rest, gzip_magic);
+
+					if (!_done)
+					{
+						inflateReset(&_stream);
+					}
+				}
+				else if (result != Z_OK)
+				{
+					throw std::runtime_error(_stream.msg ? _stream.msg : "corrupt gzip data");
+				}
+			}
+
+			return produced;
+		}
+
+	private:
+		gzip_stream(const gzip_stream&) = delete;
+		gzip_stream(gzip_stream&&) = delete;
+		gzip_stream& operator = (const gzip_stream&) = delete;
+		gzip_stream& operator = (gzip_stream&&) = delete;
+
+		// zlib takes the input in pieces it can count
+		void refill()
+		{
+			if (!_stream.avail_in && !_input.empty())
+			{
+				const size_t size = std::min(_input.size(), size_t(UINT_MAX));
+
+				_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_input.data()));
+				_stream.avail_in = static_cast<uInt>(size);
+				_input.remove_prefix(size);
+			}
+		}
+
+		std::string_view _input;
+		z_stream _stream = {};
+		bool _done = false;
+	};
+#endif
+
+#ifdef FILE_SEARCH_ZSTD
+	// Every frame in turn, skippable ones included
+	class zstd_stream
+	{
+	public:
+		explicit zstd_stream(std::string_view contents) :
+			_context(ZSTD_createDCtx()),
+			_input{ contents.data(), contents.size(), 0 }
+		{
+			if (!_context)
+			{
+				throw std::bad_alloc();
+			}
+		}
+
+		~zstd_stream()
+		{
+			ZSTD_freeDCtx(_context);
+		}
+
+		// Returns less than the size only at the end
+		size_t read(char* data, size_t size)
+		{
+			size_t produced = 0;
+
+			while (produced < size && !_done)
+			{
+				ZSTD_outBuffer output = { data + produced, size - produced, 0 };
+				const size_t result = ZSTD_decompressStream(_context, &output, &_input);
+
+				if (ZSTD_isError(result))
+				{
+					throw std::runtime_error(ZSTD_getErrorName(result));
+				}
+
+				produced += output.pos;
+
+				// With the input used up and room left, all there is has been
+				// flushed: the frame is either done or cut short
+				if (_input.pos == _input.size && output.pos < output.size)
+				{
+					if (result)
+					{
+						throw std::runtime_error("the zstd data is truncated");
+					}
+
+					_done = true;
+				}
+			}
+
+			return produced;
+		}
+
+	private:
+		zstd_stream(const zstd_stream&) = delete;
+		zstd_stream(zstd_stream&&) = delete;
+		zstd_stream& operator = (const zstd_stream&) = delete;
+		zstd_stream& operator = (zstd_stream&&) = delete;
+
+		ZSTD_DCtx* const _context;
+		ZSTD_inBuffer _input;
+		bool _done = false;
+	};
+#endif
+}
+
+compression detect_compression(std::string_view contents)
+{
+	if (starts_with(contents, gzip_magic))
+	{
+		return compression::gzip;
+	}
+
+	if (starts_with(contents, zstd_magic))
+	{
+		return compression::zstd;
+	}
+
+	return compression::none;
+}
+
+bool can_decompress(compression format)
+{
+	switch (format)
+	{
+#ifdef FILE_SEARCH_ZLIB
+		case compression::gzip:
+			return true;
+#endif
+#ifdef FILE_SEARCH_ZSTD
+		case compression::zstd:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+decompressor::decompressor(std::string_view contents, compression format) :
+	_contents(contents),
+	_format(format)
+{
+	if (!can_decompress(format))
+	{
+		throw std::invalid_argument("the compression format is not supported");
+	}
+
+	for (std::unique_ptr<char[]>& block : _blocks)
+	{
+		block = std::make_unique_for_overwrite<char[]>(block_size);
+	}
+
+	_thread = std::thread(&decompressor::run, this);
+}
+
+decompressor::~decompressor()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+
+	_changed.notify_all();
+	_thread.join();
+}
+
+std::string_view decompressor::next()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	// The block taken last is done with
+	if (_released < _taken)
+	{
+		_released = _taken;
+		_changed.notify_all();
+	}
+
+	_changed.wait(lock, [this]()
+	{
+		return _filled > _taken || _finished;
+	});
+
+	if (_filled > _taken)
+	{
+		const size_t index = _taken++ % block_count;
+		return { _blocks[index].get(), _sizes[index] };
+	}
+
+	if (_error)
+	{
+		std::rethrow_exception(_error);
+	}
+
+	return {};
+}
+
+void decompressor::run()
+{
+	std::exception_ptr error;
+
+	try
+	{
+		switch (_format)
+		{
+#ifdef FILE_SEARCH_ZLIB
+			case compression::gzip:
+			{
+				gzip_stream stream(_contents);
+				pump(stream);
+				break;
+			}
+#endif
+#ifdef FILE_SEARCH_ZSTD
+			case compression::zstd:
+			{
+				zstd_stream stream(_contents);
+				pump(stream);
+				break;
+			}
+#endif
+			default:
+				break;
+		}
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_error = error;
+		_finished = true;
+	}
+
+	_changed.notify_all();
+}
+
+template <typename Stream>
+void decompressor::pump(Stream& stream)
+{
+	for (char* block = acquire(); block; block = acquire())
+	{
+		const size_t size = stream.read(block, block_size);
+
+		if (size)
+		{
+			publish(size);
+		}
+
+		if (size < block_size)
+		{
+			break;
+		}
+	}
+}
+
+char* decompressor::acquire()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	_changed.wait(lock, [this]()
+	{
+		return _filled - _released < block_count || _stopping;
+	});
+
+	return _stopping ? nullptr : _blocks[_filled % block_count].get();
+}
+
+void decompressor::publish(size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_sizes[_filled % block_count] = size;
+		++_filled;
+	}
+
+	_changed.notify_all();
+}
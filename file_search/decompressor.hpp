@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+enum class compression
+{
+	none,
+	gzip,
+	zstd
+};
+
+// Tells the format by the magic bytes the contents start with
+compression detect_compression(std::string_view contents);
+
+// Whether the format was built in
+bool can_decompress(compression format);
+
+// Decompresses the contents on a thread of its own into a ring of a few
+// blocks, which the reader takes one at a time. The thread stays at most the
+// ring ahead of the reader, so decompressing and searching overlap while the
+// memory taken stays the same however large the decompressed contents are.
+class decompressor
+{
+public:
+	static constexpr size_t block_size = 0x100000; // 1 MiB
+	static constexpr size_t block_count = 4;
+
+	// The contents must outlive the decompressor
+	decompressor(std::string_view contents, compression format);
+	~decompressor();
+
+	// The next block of the decompressed contents, empty once they end. The
+	// block is valid until the next call. Throws if decompressing failed.
+	std::string_view next();
+
+private:
+	decompressor(const decompressor&) = delete;
+	decompressor(decompressor&&) = delete;
+	decompressor& operator = (const decompressor&) = delete;
+	decompressor& operator = (decompressor&&) = delete;
+
+	void run();
+
+	// Fills the blocks from the stream until it ends or the reader is gone
+	template <typename Stream>
+	void pump(Stream& stream);
+
+	// A free block, null when the reader is gone
+	char* acquire();
+	void publish(size_t size);
+
+	const std::string_view _contents;
+	const compression _format;
+
+	std::array<std::unique_ptr<char[]>, block_count> _blocks;
+	std::array<size_t, block_count> _sizes = {};
+
+	std::mutex _mutex;
+	std::condition_variable _changed;
+
+	// Counts of the blocks filled, taken by the reader and given back by it
+	size_t _filled = 0;
+	size_t _taken = 0;
+	size_t _released = 0;
+
+	bool _finished = false;
+	bool _stopping = false;
+	std::exception_ptr _error;
+
+	std::thread _thread;
+};
@@ -0,0 +1,228 @@
+#include "file_filter.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// A number followed by one of the suffixes or none, the multiplier of
+	// each suffix at the same index in the multipliers
+	bool parse_scaled(std::string_view value, std::string_view suffixes, const uint64_t* multipliers, uint64_t& number)
+	{
+		const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+
+		if (error != std::errc() || end == value.data())
+		{
+			return false;
+		}
+
+		const std::string_view suffix(end, static_cast<size_t>(value.data() + value.size() - end));
+
+		if (suffix.empty())
+		{
+			return true;
+		}
+
+		const size_t index = suffix.size() == 1 ? suffixes.find(suffix[0]) : std::string_view::npos;
+
+		if (index == std::string_view::npos || number > UINT64_MAX / multipliers[index])
+		{
+			return false;
+		}
+
+		number *= multipliers[index];
+		return true;
+	}
+}
+
+bool file_filter::set_max_size(std::string_view value)
+{
+	static constexpr uint64_t multipliers[] = { uint64_t(1) << 10, uint64_t(1) << 20, uint64_t(1) << 30 };
+
+	uint64_t size = 0;
+
+	if (!parse_scaled(value, "KMG", multipliers, size))
+	{
+		return false;
+	}
+
+	_max_size = size;
+	return true;
+}
+
+bool file_filter::set_newer_than(std::string_view value)
+{
+	static constexpr uint64_t multipliers[] = { 1, 60, 3600, 86400 };
+
+	uint64_t seconds = 0;
+
+	// Any age of the files there are fits in 32 bits of seconds
+	if (!parse_scaled(value, "smhd", multipliers, seconds) || seconds > UINT32_MAX)
+	{
+		return false;
+	}
+
+	_newer_than = std::chrono::system_clock::now() - std::chrono::seconds(seconds);
+	return true;
+}
+
+bool file_filter::add_extensions(std::string_view value)
+{
+	while (!value.empty())
+	{
+		const size_t comma = std::min(value.find(','), value.size());
+		std::string_view extension = value.substr(0, comma);
+		value.remove_prefix(std::min(comma + 1, value.size()));
+
+		if (extension.starts_with('.'))
+		{
+			extension.remove_prefix(1);
+		}
+
+		if (extension.empty())
+		{
+			return false;
+		}
+
+		// As the extension of a path has it
+		_extensions.insert('.' + std::string(extension));
+	}
+
+	return !_extensions.empty();
+}
+
+bool file_filter::set_type(std::string_view value)
+{
+	if (value == "f")
+	{
+		_type = file_type::regular;
+	}
+	else if (value == "l")
+	{
+		_type = file_type::symlink;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool file_filter::set_max_depth(std::string_view value)
+{
+	size_t depth = 0;
+	const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), depth);
+
+	if (error != std::errc() || end != value.data() + value.size())
+	{
+		return false;
+	}
+
+	_max_depth = depth;
+	return true;
+}
+
+bool file_filter::enters(size_t depth) const
+{
+	return !_max_depth || depth < *_max_depth;
+}
+
+bool file_filter::admits(
+	const std::filesystem::directory_entry& entry,
+	size_t depth,
+	std::optional<uint64_t>* known_size) const
+{
+	if (_max_depth && depth > *_max_depth)
+	{
+		return false;
+	}
+
+	// The listing tells a link apart without a system call
+	if (_type != file_type::any && entry.is_symlink() != (_type == file_type::symlink))
+	{
+		return false;
+	}
+
+	if (!_extensions.empty() && !_extensions.contains(entry.path().extension().string()))
+	{
+		return false;
+	}
+
+	if (!_max_size && !_newer_than)
+	{
+		return true;
+	}
+
+#if defined(__linux__)
+	// The target of a link, as the search would open it
+	struct statx status = {};
+
+	if (statx(AT_FDCWD, entry.path().c_str(), AT_STATX_SYNC_AS_STAT, STATX_SIZE | STATX_MTIME, &status) == -1)
+	{
+		return false;
+	}
+
+	const uint64_t size = status.stx_size;
+	const auto modified = std::chrono::system_clock::time_point(
+		std::chrono::duration_cast<std::chrono::system_clock::duration>(
+			std::chrono::seconds(status.stx_mtime.tv_sec) + std::chrono::nanoseconds(status.stx_mtime.tv_nsec)));
+#elif defined(_WIN32)
+	// Windows lists the size and the time along with the type
+	std::error_code error;
+	const uint64_t size = entry.file_size(error);
+
+	if (error)
+	{
+		return false;
+	}
+
+	const auto modified = std::chrono::clock_cast<std::chrono::system_clock>(entry.last_write_time(error));
+
+	if (error)
+	{
+		return false;
+	}
+#else
+	// As the result cache reads it, the clock of the file times does not
+	// convert to the system clock everywhere
+	struct stat status = {};
+
+	if (stat(entry.path().c_str(), &status) == -1)
+	{
+		return false;
+	}
+
+#if defined(__APPLE__)
+	const timespec& mtime = status.st_mtimespec;
+#else
+	const timespec& mtime = status.st_mtim;
+#endif
+
+	const uint64_t size = static_cast<uint64_t>(status.st_size);
+	const auto modified = std::chrono::system_clock::time_point(
+		std::chrono::duration_cast<std::chrono::system_clock::duration>(
+			std::chrono::seconds(mtime.tv_sec) + std::chrono::nanoseconds(mtime.tv_nsec)));
+#endif
+
+	if (known_size)
+	{
+		*known_size = size;
+	}
+
+	if (_max_size && size > *_max_size)
+	{
+		return false;
+	}
+
+	return !_newer_than || modified > *_newer_than;
+}
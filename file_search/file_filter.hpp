@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// Narrows the files searched down by what is known of them before they are
+// opened. The type and the extension come from the directory listing, whose
+// entries cache the type; the size and the modification time, only when they
+// are asked for, take a single stat of the file. A file the filter excludes
+// is never opened.
+//
+// The setters parse a value of the command line and return false if it is
+// not valid. Without any, every file passes.
+class file_filter
+{
+public:
+	// Bytes, with an optional K, M or G suffix for KiB, MiB or GiB
+	bool set_max_size(std::string_view value);
+
+	// An age, a number with an s, m, h or d suffix
+	bool set_newer_than(std::string_view value);
+
+	// Comma separated extensions, with or without the dot, added to those
+	// set before
+	bool add_extensions(std::string_view value);
+
+	// f for files that are not links, l for links to files
+	bool set_type(std::string_view value);
+
+	// The number of directories the walk goes down below the folder
+	bool set_max_depth(std::string_view value);
+
+	// Whether the walk enters a directory at the depth. The entries of the
+	// searched folder itself are at depth 0.
+	bool enters(size_t depth) const;
+
+	// Whether to search the regular file of the entry, which is at the depth.
+	// The file is assumed to be regular, which the walk checks up front. The
+	// size of the file is stored in the known size, if given and taken.
+	bool admits(
+		const std::filesystem::directory_entry& entry,
+		size_t depth,
+		std::optional<uint64_t>* known_size = nullptr) const;
+
+private:
+	enum class file_type
+	{
+		any,
+		regular,
+		symlink
+	};
+
+	std::optional<uint64_t> _max_size;
+	std::optional<std::chrono::system_clock::time_point> _newer_than;
+	std::unordered_set<std::string> _extensions;
+	file_type _type = file_type::any;
+	std::optional<size_t> _max_depth;
+};
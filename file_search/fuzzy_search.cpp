@@ -0,0 +1,107 @@
+#include "fuzzy_search.hpp"
+
+#include <stdexcept>
+
+fuzzy_searcher::fuzzy_searcher(std::string_view pattern, uint32_t max_distance, bool ignore_case) :
+	_pattern(pattern),
+	_pattern_size(static_cast<uint32_t>(pattern.size())),
+	_max_distance(max_distance)
+{
+	if (pattern.size() > max_pattern_size)
+	{
+		throw std::invalid_argument("the pattern is longer than 64 bytes");
+	}
+
+	for (size_t i = 0; i < pattern.size(); ++i)
+	{
+		const unsigned char c = static_cast<unsigned char>(pattern[i]);
+		const uint64_t bit = uint64_t(1) << i;
+
+		_positions[c] |= bit;
+
+		// Either case of a letter stands for the position
+		if (ignore_case && ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
+		{
+			_positions[c ^ 0x20] |= bit;
+		}
+	}
+
+	if (_pattern_size)
+	{
+		_last_bit = uint64_t(1) << (_pattern_size - 1);
+	}
+}
+
+bool fuzzy_searcher::search(std::string_view line) const
+{
+	// Dropping the whole pattern is within the distance anywhere
+	if (_pattern_size <= _max_distance)
+	{
+		return true;
+	}
+
+	// The vertical deltas of the current column, all +1 down the first one,
+	// and the distance at the bottom of it. Bits above the pattern are never
+	// read, carries only move upwards.
+	uint64_t positive = ~uint64_t(0);
+	uint64_t negative = 0;
+	uint32_t distance = _pattern_size;
+
+	for (const char c : line)
+	{
+		const uint64_t equal = _positions[static_cast<unsigned char>(c)];
+		const uint64_t vertical = equal | negative;
+		const uint64_t horizontal = (((equal & positive) + positive) ^ positive) | equal;
+
+		uint64_t horizontal_positive = negative | ~(horizontal | positive);
+		uint64_t horizontal_negative = positive & horizontal;
+
+		if (horizontal_positive & _last_bit)
+		{
+			++distance;
+		}
+		else if (horizontal_negative & _last_bit)
+		{
+			--distance;
+		}
+
+		if (distance <= _max_distance)
+		{
+			return true;
+		}
+
+		// A match may start anywhere, so the top row stays zero and nothing
+		// is shifted in
+		horizontal_positive <<= 1;
+		horizontal_negative <<= 1;
+
+		positive = horizontal_negative | ~(vertical | horizontal_positive);
+		negative = horizontal_positive & vertical;
+	}
+
+	return false;
+}
+
+std::vector<std::string> fuzzy_searcher::exact_pieces() const
+{
+	// Shorter pieces hit on nearly every line
+	constexpr size_t min_piece_size = 3;
+
+	const size_t count = size_t(_max_distance) + 1;
+
+	if (_pattern.size() / count < min_piece_size)
+	{
+		return {};
+	}
+
+	std::vector<std::string> pieces;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const size_t begin = _pattern.size() * i / count;
+		const size_t end = _pattern.size() * (i + 1) / count;
+		pieces.emplace_back(_pattern.substr(begin, end - begin));
+	}
+
+	return pieces;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Approximate substring search: finds whether a text contains the pattern
+// within a Levenshtein distance, counting insertions, deletions and
+// substitutions. The dynamic programming matrix is computed a column at a time
+// as bit vectors after Myers, so a pattern of up to 64 bytes takes a handful
+// of word operations per byte of text whatever the distance.
+class fuzzy_searcher
+{
+public:
+	static constexpr size_t max_pattern_size = 64;
+
+	// Throws std::invalid_argument for a pattern longer than the maximum.
+	// Ignoring the case folds ASCII letters only.
+	fuzzy_searcher(std::string_view pattern, uint32_t max_distance, bool ignore_case = false);
+
+	// True if some part of the line is within the distance of the pattern
+	bool search(std::string_view line) const;
+
+	// Cut into one more piece than the distance, the pattern keeps at least
+	// one of them intact in any match, so only the lines containing one need
+	// be searched. Empty when the pieces would be too short to pay off.
+	std::vector<std::string> exact_pieces() const;
+
+private:
+	std::string _pattern;
+
+	// The positions in the pattern of each byte value
+	std::array<uint64_t, 256> _positions = {};
+	uint64_t _last_bit = 0;
+	uint32_t _pattern_size = 0;
+	uint32_t _max_distance = 0;
+};
@@ -0,0 +1,1078 @@
+#include "grep_regex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using byte_set = std::bitset<256>;
+
+	constexpr uint32_t unbounded = std::numeric_limits<uint32_t>::max();
+	constexpr uint32_t repeat_limit = 0xFF; // RE_DUP_MAX
+	constexpr size_t nfa_state_limit = 0x10000;
+	constexpr size_t dfa_memory_budget = 0x800000; // 8 MiB of transitions
+
+	class backreference_error : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	struct node
+	{
+		enum class kind
+		{
+			empty,
+			bytes,
+			concat,
+			alternate,
+			repeat,
+			line_begin,
+			line_end
+		};
+
+		explicit node(kind type) :
+			type(type)
+		{
+		}
+
+		kind type;
+		byte_set bytes;
+		std::vector<node> children;
+		uint32_t min = 0;
+		uint32_t max = 0;
+	};
+
+	class parser
+	{
+	public:
+		parser(std::string_view expression, bool ignore_case) :
+			_expression(expression),
+			_ignore_case(ignore_case)
+		{
+		}
+
+		node parse()
+		{
+			node alternatives(node::kind::alternate);
+
+			while (true)
+			{
+				alternatives.children.emplace_back(parse_sequence(false));
+
+				if (_position >= _expression.size())
+				{
+					break;
+				}
+
+				// Skip the newline separating the alternatives
+				++_position;
+			}
+
+			if (_backreference)
+			{
+				throw backreference_error("back-references cannot be matched by an automaton");
+			}
+
+			return alternatives;
+		}
+
+	private:
+		bool at(std::string_view token, size_t position) const
+		{
+			return _expression.substr(position, token.size()) == token;
+		}
+
+		bool at_sequence_end(size_t position) const
+		{
+			return position >= _expression.size() || _expression[position] == '\n' || at("\\)", position);
+		}
+
+		node parse_sequence(bool in_group)
+		{
+			node sequence(node::kind::concat);
+
+			// A star at the start of a sequence is an ordinary character
+			bool at_start = true;
+
+			while (_position < _expression.size())
+			{
+				const char c = _expression[_position];
+
+				if (c == '\n' && in_group)
+				{
+					throw std::regex_error(std::regex_constants::error_paren);
+				}
+
+				if (at("\\)", _position) && !in_group)
+				{
+					throw std::regex_error(std::regex_constants::error_paren);
+				}
+
+				if (at_sequence_end(_position))
+				{
+					break;
+				}
+
+				if (c == '^' && at_start)
+				{
+					++_position;
+					sequence.children.emplace_back(node::kind::line_begin);
+					continue;
+				}
+
+				if (c == '$' && at_sequence_end(_position + 1))
+				{
+					++_position;
+					sequence.children.emplace_back(node::kind::line_end);
+					at_start = false;
+					continue;
+				}
+
+				if (c == '*' && !at_start)
+				{
+					++_position;
+					apply_repeat(sequence, 0, unbounded);
+					continue;
+				}
+
+				if (at("\\{", _position))
+				{
+					if (at_start)
+					{
+						throw std::regex_error(std::regex_constants::error_badrepeat);
+					}
+
+					_position += 2;
+					const auto [min, max] = parse_interval();
+					apply_repeat(sequence, min, max);
+					continue;
+				}
+
+				sequence.children.emplace_back(parse_atom());
+				at_start = false;
+			}
+
+			return sequence;
+		}
+
+		node parse_atom()
+		{
+			const char c = _expression[_position];
+
+			if (c == '[')
+			{
+				return parse_bracket();
+			}
+
+			if (c == '.')
+			{
+				++_position;
+				node any(node::kind::bytes);
+				any.bytes.set();
+				any.bytes.reset('\n');
+				return any;
+			}
+
+			if (c != '\\')
+			{
+				++_position;
+				return literal(c);
+			}
+
+			if (_position + 1 >= _expression.size())
+			{
+				throw std::regex_error(std::regex_constants::error_escape);
+			}
+
+			const char escaped = _expression[_position + 1];
+			_position += 2;
+
+			if (escaped == '(')
+			{
+				node group = parse_sequence(true);
+
+				if (!at("\\)", _position))
+				{
+					throw std::regex_error(std::regex_constants::error_paren);
+				}
+
+				_position += 2;
+				return group;
+			}
+
+			if (escaped >= '1' && escaped <= '9')
+			{
+				// The rest is still parsed, the escapes std::regex would take
+				// as literals are rejected all the same
+				_backreference = true;
+				return node(node::kind::empty);
+			}
+
+			// GNU grep reads these as operators, alternation, repetition, word
+			// boundaries and classes, which the dialect does not have. Taking
+			// them as the literal character would quietly match something else.
+			if (std::isalnum(static_cast<unsigned char>(escaped)) || std::string_view("|+?<>`'").find(escaped) != std::string_view::npos)
+			{
+				throw std::regex_error(std::regex_constants::error_escape);
+			}
+
+			return literal(escaped);
+		}
+
+		std::pair<uint32_t, uint32_t> parse_interval()
+		{
+			const auto parse_number = [this](uint32_t fallback)
+			{
+				if (_position >= _expression.size() || !std::isdigit(static_cast<unsigned char>(_expression[_position])))
+				{
+					return fallback;
+				}
+
+				uint32_t value = 0;
+
+				while (_position < _expression.size() && std::isdigit(static_cast<unsigned char>(_expression[_position])))
+				{
+					value = value * 10 + (_expression[_position++] - '0');
+
+					if (value > repeat_limit)
+					{
+						throw std::regex_error(std::regex_constants::error_badbrace);
+					}
+				}
+
+				return value;
+			};
+
+			const uint32_t min = parse_number(0);
+			uint32_t max = min;
+
+			if (_position < _expression.size() && _expression[_position] == ',')
+			{
+				++_position;
+				max = parse_number(unbounded);
+			}
+
+			if (!at("\\}", _position))
+			{
+				throw std::regex_error(std::regex_constants::error_brace);
+			}
+
+			_position += 2;
+
+			if (min > max)
+			{
+				throw std::regex_error(std::regex_constants::error_badbrace);
+			}
+
+			return { min, max };
+		}
+
+		static void apply_repeat(node& sequence, uint32_t min, uint32_t max)
+		{
+			node repeat(node::kind::repeat);
+			repeat.min = min;
+			repeat.max = max;
+			repeat.children.emplace_back(std::move(sequence.children.back()));
+			sequence.children.back() = std::move(repeat);
+		}
+
+		node literal(char c) const
+		{
+			node result(node::kind::bytes);
+			result.bytes.set(static_cast<unsigned char>(c));
+
+			if (_ignore_case)
+			{
+				fold_case(result.bytes);
+			}
+
+			return result;
+		}
+
+		static void fold_case(byte_set& bytes)
+		{
+			for (int c = 'a'; c <= 'z'; ++c)
+			{
+				if (bytes[c] || bytes[std::toupper(c)])
+				{
+					bytes.set(c);
+					bytes.set(std::toupper(c));
+				}
+			}
+		}
+
+		static void add_class(byte_set& bytes, std::string_view name)
+		{
+			using predicate = int(*)(int);
+
+			static const std::map<std::string_view, predicate> classes =
+			{
+				{ "alnum", [](int c) { return std::isalnum(c); } },
+				{ "alpha", [](int c) { return std::isalpha(c); } },
+				{ "blank", [](int c) { return std::isblank(c); } },
+				{ "cntrl", [](int c) { return std::iscntrl(c); } },
+				{ "digit", [](int c) { return std::isdigit(c); } },
+				{ "graph", [](int c) { return std::isgraph(c); } },
+				{ "lower", [](int c) { return std::islower(c); } },
+				{ "print", [](int c) { return std::isprint(c); } },
+				{ "punct", [](int c) { return std::ispunct(c); } },
+				{ "space", [](int c) { return std::isspace(c); } },
+				{ "upper", [](int c) { return std::isupper(c); } },
+				{ "xdigit", [](int c) { return std::isxdigit(c); } }
+			};
+
+			const auto iter = classes.find(name);
+
+			if (iter == classes.cend())
+			{
+				throw std::regex_error(std::regex_constants::error_ctype);
+			}
+
+			for (int c = 0; c < 0x80; ++c)
+			{
+				if (iter->second(c))
+				{
+					bytes.set(c);
+				}
+			}
+		}
+
+		// A single character of a bracket expression, either plain or as
+		// a collating symbol or an equivalence class of one character
+		unsigned char parse_bracket_character()
+		{
+			if (at("[.", _position) || at("[=", _position))
+			{
+				const char terminator[] = { _expression[_position + 1], ']' };
+				const size_t end = _expression.find(std::string_view(terminator, 2), _position + 2);
+
+				if (end == std::string_view::npos)
+				{
+					throw std::regex_error(std::regex_constants::error_brack);
+				}
+
+				if (end != _position + 3)
+				{
+					throw std::regex_error(std::regex_constants::error_collate);
+				}
+
+				const char c = _expression[_position + 2];
+				_position = end + 2;
+				return static_cast<unsigned char>(c);
+			}
+
+			return static_cast<unsigned char>(_expression[_position++]);
+		}
+
+		node parse_bracket()
+		{
+			node result(node::kind::bytes);
+			++_position;
+
+			const bool negate = _position < _expression.size() && _expression[_position] == '^';
+
+			if (negate)
+			{
+				++_position;
+			}
+
+			for (bool first = true; ; first = false)
+			{
+				if (_position >= _expression.size())
+				{
+					throw std::regex_error(std::regex_constants::error_brack);
+				}
+
+				if (_expression[_position] == ']' && !first)
+				{
+					++_position;
+					break;
+				}
+
+				if (at("[:", _position))
+				{
+					const size_t end = _expression.find(":]", _position + 2);
+
+					if (end == std::string_view::npos)
+					{
+						throw std::regex_error(std::regex_constants::error_brack);
+					}
+
+					add_class(result.bytes, _expression.substr(_position + 2, end - _position - 2));
+					_position = end + 2;
+					continue;
+				}
+
+				const unsigned char low = parse_bracket_character();
+
+				if (_position + 1 < _expression.size() && _expression[_position] == '-' && _expression[_position + 1] != ']')
+				{
+					++_position;
+					const unsigned char high = parse_bracket_character();
+
+					if (high < low)
+					{
+						throw std::regex_error(std::regex_constants::error_range);
+					}
+
+					for (int c = low; c <= high; ++c)
+					{
+						result.bytes.set(c);
+					}
+
+					continue;
+				}
+
+				result.bytes.set(low);
+			}
+
+			if (_ignore_case)
+			{
+				fold_case(result.bytes);
+			}
+
+			if (negate)
+			{
+				result.bytes.flip();
+				result.bytes.reset('\n');
+			}
+
+			return result;
+		}
+
+		const std::string_view _expression;
+		const bool _ignore_case;
+		size_t _position = 0;
+		bool _backreference = false;
+	};
+
+	// What a node tells about the literal text every match has to contain
+	struct literal_factors
+	{
+		// The only string the node can match, if there is just one
+		std::optional<std::string> exact;
+
+		// The longest string every match of the node contains
+		std::string required;
+	};
+
+	// The character a byte set stands for, if it is a single one. When the
+	// case is ignored the set of both cases counts as the lower case letter.
+	std::optional<char> single_character(const byte_set& bytes, bool ignore_case)
+	{
+		if (bytes.count() == 1)
+		{
+			for (int c = 0; c < 0x100; ++c)
+			{
+				if (bytes[c])
+				{
+					return static_cast<char>(c);
+				}
+			}
+		}
+
+		if (ignore_case && bytes.count() == 2)
+		{
+			for (int c = 'a'; c <= 'z'; ++c)
+			{
+				if (bytes[c] && bytes[std::toupper(c)])
+				{
+					return static_cast<char>(c);
+				}
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	literal_factors analyze(const node& node, bool ignore_case)
+	{
+		literal_factors result;
+
+		const auto keep_longest = [&](const std::string& candidate)
+		{
+			if (candidate.size() > result.required.size())
+			{
+				result.required = candidate;
+			}
+		};
+
+		switch (node.type)
+		{
+			case node::kind::empty:
+			case node::kind::line_begin:
+			case node::kind::line_end:
+			{
+				result.exact = std::string();
+				break;
+			}
+			case node::kind::bytes:
+			{
+				const std::optional<char> c = single_character(node.bytes, ignore_case);
+
+				if (c)
+				{
+					result.exact = std::string(1, *c);
+					result.required = *result.exact;
+				}
+
+				break;
+			}
+			case node::kind::concat:
+			{
+				// Adjacent exact children form one literal, anything else ends it
+				std::string run;
+				bool all_exact = true;
+
+				for (const auto& child : node.children)
+				{
+					const literal_factors factors = analyze(child, ignore_case);
+					keep_longest(factors.required);
+
+					if (factors.exact)
+					{
+						run += *factors.exact;
+						keep_longest(run);
+						continue;
+					}
+
+					run.clear();
+					all_exact = false;
+				}
+
+				if (all_exact)
+				{
+					result.exact = run;
+				}
+
+				break;
+			}
+			case node::kind::alternate:
+			{
+				// Alternatives would need a literal each, only a lone one counts
+				if (node.children.size() == 1)
+				{
+					result = analyze(node.children.front(), ignore_case);
+				}
+
+				break;
+			}
+			case node::kind::repeat:
+			{
+				if (node.min == 0)
+				{
+					break;
+				}
+
+				const literal_factors factors = analyze(node.children.front(), ignore_case);
+				result.required = factors.required;
+
+				if (factors.exact && node.min == node.max)
+				{
+					result.exact = std::string();
+
+					for (uint32_t i = 0; i < node.min; ++i)
+					{
+						*result.exact += *factors.exact;
+					}
+
+					keep_longest(*result.exact);
+				}
+
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	struct nfa_state
+	{
+		enum class kind : uint8_t
+		{
+			bytes,
+			split,
+			line_begin,
+			line_end,
+			match
+		};
+
+		kind type;
+		uint32_t set = 0;
+		uint32_t out = 0;
+		uint32_t out1 = 0;
+	};
+
+	// Scratch space for computing the states reachable without consuming input
+	struct closure_scratch
+	{
+		explicit closure_scratch(size_t state_count) :
+			marks(state_count)
+		{
+		}
+
+		std::vector<uint32_t> marks;
+		std::vector<uint32_t> stack;
+		uint32_t generation = 0;
+	};
+}
+
+class grep_regex_impl
+{
+public:
+	grep_regex_impl(std::string_view expression, bool ignore_case)
+	{
+		// The match state is always the first one
+		_states.push_back({ nfa_state::kind::match, 0, 0, 0 });
+		const node root = parser(expression, ignore_case).parse();
+		_required_literal = analyze(root, ignore_case).required;
+		_start = compile(root, 0);
+
+		build_classes();
+
+		_state_limit = std::clamp(dfa_memory_budget / (_class_count * sizeof(uint32_t)), size_t(0x10), size_t(0x10000));
+		_transitions = std::make_unique<std::atomic<uint32_t>[]>(_state_limit * _class_count);
+		_flags = std::make_unique<uint8_t[]>(_state_limit);
+
+		closure_scratch scratch(_states.size());
+
+		++scratch.generation;
+		add_closure(_start, false, _restart, scratch);
+		std::sort(_restart.begin(), _restart.end());
+
+		std::vector<uint32_t> initial;
+		++scratch.generation;
+		add_closure(_start, true, initial, scratch);
+		std::sort(initial.begin(), initial.end());
+
+		_initial = add_dfa_state(std::move(initial), scratch);
+	}
+
+	bool search(std::string_view line)
+	{
+		uint32_t state = _initial;
+
+		for (size_t i = 0; i < line.size(); ++i)
+		{
+			const uint8_t flags = _flags[state];
+
+			if (flags & (matched | dead))
+			{
+				return flags & matched;
+			}
+
+			const size_t byte_class = _classes[static_cast<unsigned char>(line[i])];
+			uint32_t next = _transitions[state * _class_count + byte_class].load(std::memory_order_acquire);
+
+			if (next == unknown)
+			{
+				next = compute_transition(state, byte_class);
+
+				if (next == cache_full)
+				{
+					return simulate(state, line.substr(i));
+				}
+			}
+
+			state = next - 1;
+		}
+
+		return _flags[state] & (matched | matched_at_end);
+	}
+
+	const std::string& required_literal() const
+	{
+		return _required_literal;
+	}
+
+private:
+	static constexpr uint32_t unknown = 0;
+	static constexpr uint32_t cache_full = std::numeric_limits<uint32_t>::max();
+
+	enum flag : uint8_t
+	{
+		matched = 1,
+		matched_at_end = 2,
+		dead = 4
+	};
+
+	uint32_t add_nfa_state(const nfa_state& state)
+	{
+		if (_states.size() >= nfa_state_limit)
+		{
+			throw std::regex_error(std::regex_constants::error_complexity);
+		}
+
+		_states.push_back(state);
+		return static_cast<uint32_t>(_states.size() - 1);
+	}
+
+	uint32_t add_byte_set(const byte_set& bytes)
+	{
+		const auto iter = std::find(_byte_sets.cbegin(), _byte_sets.cend(), bytes);
+
+		if (iter != _byte_sets.cend())
+		{
+			return static_cast<uint32_t>(iter - _byte_sets.cbegin());
+		}
+
+		_byte_sets.push_back(bytes);
+		return static_cast<uint32_t>(_byte_sets.size() - 1);
+	}
+
+	// Compiles the node so that it continues to the given state, returns the entry state
+	uint32_t compile(const node& node, uint32_t next)
+	{
+		switch (node.type)
+		{
+			case node::kind::empty:
+			{
+				return next;
+			}
+			case node::kind::bytes:
+			{
+				return add_nfa_state({ nfa_state::kind::bytes, add_byte_set(node.bytes), next, 0 });
+			}
+			case node::kind::concat:
+			{
+				for (auto iter = node.children.crbegin(); iter != node.children.crend(); ++iter)
+				{
+					next = compile(*iter, next);
+				}
+
+				return next;
+			}
+			case node::kind::alternate:
+			{
+				uint32_t entry = compile(node.children.back(), next);
+
+				for (size_t i = node.children.size() - 1; i > 0; --i)
+				{
+					const uint32_t alternative = compile(node.children[i - 1], next);
+					entry = add_nfa_state({ nfa_state::kind::split, 0, alternative, entry });
+				}
+
+				return entry;
+			}
+			case node::kind::repeat:
+			{
+				const auto& child = node.children.front();
+				uint32_t entry = next;
+
+				if (node.max == unbounded)
+				{
+					const uint32_t loop = add_nfa_state({ nfa_state::kind::split, 0, 0, next });
+					const uint32_t body = compile(child, loop);
+					_states[loop].out = body;
+					entry = loop;
+				}
+				else
+				{
+					for (uint32_t i = node.min; i < node.max; ++i)
+					{
+						const uint32_t body = compile(child, entry);
+						entry = add_nfa_state({ nfa_state::kind::split, 0, body, entry });
+					}
+				}
+
+				for (uint32_t i = 0; i < node.min; ++i)
+				{
+					entry = compile(child, entry);
+				}
+
+				return entry;
+			}
+			case node::kind::line_begin:
+			{
+				return add_nfa_state({ nfa_state::kind::line_begin, 0, next, 0 });
+			}
+			case node::kind::line_end:
+			{
+				return add_nfa_state({ nfa_state::kind::line_end, 0, next, 0 });
+			}
+		}
+
+		return next;
+	}
+
+	// Bytes that no byte set tells apart share a class, which keeps the DFA narrow
+	void build_classes()
+	{
+		std::map<std::string, uint8_t> signatures;
+
+		for (size_t c = 0; c < _classes.size(); ++c)
+		{
+			std::string signature(_byte_sets.size(), '0');
+
+			for (size_t i = 0; i < _byte_sets.size(); ++i)
+			{
+				signature[i] = _byte_sets[i][c] ? '1' : '0';
+			}
+
+			const auto [iter, inserted] = signatures.emplace(signature, static_cast<uint8_t>(signatures.size()));
+
+			if (inserted)
+			{
+				_representatives.push_back(static_cast<uint8_t>(c));
+			}
+
+			_classes[c] = iter->second;
+		}
+
+		_class_count = signatures.size();
+	}
+
+	void add_closure(uint32_t state, bool at_begin, std::vector<uint32_t>& set, closure_scratch& scratch) const
+	{
+		scratch.stack.push_back(state);
+
+		while (!scratch.stack.empty())
+		{
+			const uint32_t current = scratch.stack.back();
+			scratch.stack.pop_back();
+
+			if (scratch.marks[current] == scratch.generation)
+			{
+				continue;
+			}
+
+			scratch.marks[current] = scratch.generation;
+
+			const nfa_state& nfa = _states[current];
+
+			switch (nfa.type)
+			{
+				case nfa_state::kind::split:
+				{
+					scratch.stack.push_back(nfa.out1);
+					scratch.stack.push_back(nfa.out);
+					break;
+				}
+				case nfa_state::kind::line_begin:
+				{
+					if (at_begin)
+					{
+						scratch.stack.push_back(nfa.out);
+					}
+
+					break;
+				}
+				default:
+				{
+					set.push_back(current);
+					break;
+				}
+			}
+		}
+	}
+
+	// The states reached from the set by the byte, plus a new attempt from the start
+	void step(const std::vector<uint32_t>& current, unsigned char c, std::vector<uint32_t>& next, closure_scratch& scratch) const
+	{
+		next.clear();
+		++scratch.generation;
+
+		for (uint32_t state : current)
+		{
+			const nfa_state& nfa = _states[state];
+
+			if (nfa.type == nfa_state::kind::bytes && _byte_sets[nfa.set][c])
+			{
+				add_closure(nfa.out, false, next, scratch);
+			}
+		}
+
+		for (uint32_t state : _restart)
+		{
+			add_closure(state, false, next, scratch);
+		}
+	}
+
+	bool accepts_at_end(const std::vector<uint32_t>& set, closure_scratch& scratch) const
+	{
+		std::vector<uint32_t> reached;
+		++scratch.generation;
+
+		for (uint32_t state : set)
+		{
+			if (state == 0)
+			{
+				return true;
+			}
+
+			if (_states[state].type == nfa_state::kind::line_end)
+			{
+				add_closure(_states[state].out, false, reached, scratch);
+			}
+		}
+
+		return std::find(reached.cbegin(), reached.cend(), 0) != reached.cend();
+	}
+
+	uint32_t add_dfa_state(std::vector<uint32_t>&& set, closure_scratch& scratch)
+	{
+		const uint32_t id = static_cast<uint32_t>(_sets.size());
+		uint8_t flags = 0;
+
+		if (set.empty())
+		{
+			flags |= dead;
+		}
+		else if (set.front() == 0)
+		{
+			flags |= matched;
+		}
+		else if (accepts_at_end(set, scratch))
+		{
+			flags |= matched_at_end;
+		}
+
+		_flags[id] = flags;
+		_ids.emplace(set, id);
+		_sets.emplace_back(std::move(set));
+
+		return id;
+	}
+
+	uint32_t compute_transition(uint32_t state, size_t byte_class)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		std::atomic<uint32_t>& transition = _transitions[state * _class_count + byte_class];
+		const uint32_t known = transition.load(std::memory_order_relaxed);
+
+		if (known != unknown)
+		{
+			return known;
+		}
+
+		if (!_scratch)
+		{
+			_scratch = std::make_unique<closure_scratch>(_states.size());
+		}
+
+		std::vector<uint32_t> next;
+		step(_sets[state], _representatives[byte_class], next, *_scratch);
+		std::sort(next.begin(), next.end());
+
+		const auto iter = _ids.find(next);
+		uint32_t id = 0;
+
+		if (iter != _ids.cend())
+		{
+			id = iter->second;
+		}
+		else if (_sets.size() < _state_limit)
+		{
+			id = add_dfa_state(std::move(next), *_scratch);
+		}
+		else
+		{
+			return cache_full;
+		}
+
+		transition.store(id + 1, std::memory_order_release);
+		return id + 1;
+	}
+
+	// The DFA ran out of room, continue from its state by simulating the NFA
+	bool simulate(uint32_t state, std::string_view rest) const
+	{
+		std::vector<uint32_t> current;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			current = _sets[state];
+		}
+
+		closure_scratch scratch(_states.size());
+		std::vector<uint32_t> next;
+
+		for (char c : rest)
+		{
+			if (std::find(current.cbegin(), current.cend(), 0) != current.cend())
+			{
+				return true;
+			}
+
+			step(current, static_cast<unsigned char>(c), next, scratch);
+			current.swap(next);
+		}
+
+		return accepts_at_end(current, scratch);
+	}
+
+	std::string _required_literal;
+
+	std::vector<nfa_state> _states;
+	std::vector<byte_set> _byte_sets;
+	uint32_t _start = 0;
+	std::vector<uint32_t> _restart;
+
+	std::array<uint8_t, 256> _classes = {};
+	std::vector<uint8_t> _representatives;
+	size_t _class_count = 0;
+
+	size_t _state_limit = 0;
+	std::unique_ptr<std::atomic<uint32_t>[]> _transitions;
+	std::unique_ptr<uint8_t[]> _flags;
+	uint32_t _initial = 0;
+
+	// Guards the construction of new DFA states
+	mutable std::mutex _mutex;
+	std::vector<std::vector<uint32_t>> _sets;
+	std::map<std::vector<uint32_t>, uint32_t> _ids;
+	std::unique_ptr<closure_scratch> _scratch;
+};
+
+grep_regex::grep_regex(std::string_view expression, bool ignore_case)
+{
+	try
+	{
+		_impl = std::make_shared<grep_regex_impl>(expression, ignore_case);
+	}
+	catch (const backreference_error&)
+	{
+		auto flags = std::regex::grep;
+
+		if (ignore_case)
+		{
+			flags |= std::regex::icase;
+		}
+
+		_fallback = std::make_shared<const std::regex>(expression.cbegin(), expression.cend(), flags);
+	}
+}
+
+bool grep_regex::search(std::string_view line) const
+{
+	if (_fallback)
+	{
+		return std::regex_search(line.cbegin(), line.cend(), *_fallback);
+	}
+
+	return _impl->search(line);
+}
+
+std::string_view grep_regex::required_literal() const
+{
+	if (_fallback)
+	{
+		return {};
+	}
+
+	return _impl->required_literal();
+}
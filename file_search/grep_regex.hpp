@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <regex>
+#include <string_view>
+
+class grep_regex_impl;
+
+// POSIX basic regular expressions, with newline separated alternatives, in the
+// dialect of std::regex::grep. The expression is compiled to an NFA which is
+// turned into a DFA lazily while searching. When the DFA grows too large the
+// search continues by simulating the NFA, so matching is always linear in the
+// length of the input. Copies share the DFA, which is safe to use from several
+// threads at once.
+//
+// Back-references cannot be matched by an automaton, expressions using them
+// are handed to std::regex instead. Invalid expressions throw std::regex_error,
+// as do the escapes GNU grep reads as operators, such as \| and \+.
+class grep_regex
+{
+public:
+	grep_regex(std::string_view expression, bool ignore_case);
+
+	// True if the expression matches anywhere within the line
+	bool search(std::string_view line) const;
+
+	// The longest literal every match contains, empty if there is none. When
+	// the case is ignored the literal is in lower case and has to be searched
+	// for ignoring the case as well.
+	std::string_view required_literal() const;
+
+private:
+	std::shared_ptr<grep_regex_impl> _impl;
+	std::shared_ptr<const std::regex> _fallback;
+};
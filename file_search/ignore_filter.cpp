@@ -0,0 +1,364 @@
+#include "ignore_filter.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	constexpr std::string_view ignore_files[] = { ".gitignore", ".ignore" };
+
+	bool has_wildcards(std::string_view pattern)
+	{
+		return pattern.find_first_of("*?[\\") != std::string_view::npos;
+	}
+
+	// Matches a bracket expression at the start of the pattern against the
+	// character, returns the length of the expression or zero if it is not one
+	size_t match_class(std::string_view pattern, char c, bool& matched)
+	{
+		size_t i = 1;
+		const bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+
+		if (negated)
+		{
+			++i;
+		}
+
+		matched = false;
+
+		for (size_t first = i; i < pattern.size(); ++i)
+		{
+			if (pattern[i] == ']' && i != first)
+			{
+				matched = matched != negated && c != '/';
+				return i + 1;
+			}
+
+			if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']')
+			{
+				matched = matched || (c >= pattern[i] && c <= pattern[i + 2]);
+				i += 2;
+			}
+			else
+			{
+				matched = matched || c == pattern[i];
+			}
+		}
+
+		return 0;
+	}
+
+	// Glob matching as git does it: a star stays within a path component, a
+	// double star as a whole component spans any number of them
+	bool glob_match(std::string_view pattern, std::string_view text)
+	{
+		while (!pattern.empty())
+		{
+			if (pattern.starts_with("**"))
+			{
+				std::string_view rest = pattern.substr(2);
+
+				if (rest.empty())
+				{
+					return true;
+				}
+
+				if (rest.front() == '/')
+				{
+					rest.remove_prefix(1);
+
+					for (size_t i = 0; ; ++i)
+					{
+						if (glob_match(rest, text.substr(i)))
+						{
+							return true;
+						}
+
+						i = text.find('/', i);
+
+						if (i == std::string_view::npos)
+						{
+							return false;
+						}
+					}
+				}
+
+				pattern.remove_prefix(1);
+				continue;
+			}
+
+			if (pattern.front() == '*')
+			{
+				const std::string_view rest = pattern.substr(1);
+
+				for (size_t i = 0; ; ++i)
+				{
+					if (glob_match(rest, text.substr(i)))
+					{
+						return true;
+					}
+
+					if (i == text.size() || text[i] == '/')
+					{
+						return false;
+					}
+				}
+			}
+
+			if (text.empty())
+			{
+				return false;
+			}
+
+			if (pattern.front() == '?')
+			{
+				if (text.front() == '/')
+				{
+					return false;
+				}
+
+				pattern.remove_prefix(1);
+				text.remove_prefix(1);
+				continue;
+			}
+
+			if (pattern.front() == '[')
+			{
+				bool matched = false;
+				const size_t length = match_class(pattern, text.front(), matched);
+
+				if (length)
+				{
+					if (!matched)
+					{
+						return false;
+					}
+
+					pattern.remove_prefix(length);
+					text.remove_prefix(1);
+					continue;
+				}
+			}
+
+			if (pattern.front() == '\\' && pattern.size() > 1)
+			{
+				pattern.remove_prefix(1);
+			}
+
+			if (pattern.front() != text.front())
+			{
+				return false;
+			}
+
+			pattern.remove_prefix(1);
+			text.remove_prefix(1);
+		}
+
+		return text.empty();
+	}
+
+	std::string_view trim_line(std::string_view line)
+	{
+		if (line.ends_with('\r'))
+		{
+			line.remove_suffix(1);
+		}
+
+		// Trailing spaces do not count unless escaped
+		while (line.ends_with(' ') && !line.ends_with("\\ "))
+		{
+			line.remove_suffix(1);
+		}
+
+		return line;
+	}
+}
+
+void ignore_matcher::add_rules(std::string_view contents)
+{
+	while (!contents.empty())
+	{
+		const size_t line_end = std::min(contents.find('\n'), contents.size());
+		std::string_view line = trim_line(contents.substr(0, line_end));
+		contents.remove_prefix(std::min(line_end + 1, contents.size()));
+
+		if (line.empty() || line.front() == '#')
+		{
+			continue;
+		}
+
+		const bool negated = line.front() == '!';
+
+		if (negated || line.starts_with("\\!") || line.starts_with("\\#"))
+		{
+			line.remove_prefix(1);
+		}
+
+		const bool directory_only = line.ends_with('/');
+
+		if (directory_only)
+		{
+			line.remove_suffix(1);
+		}
+
+		// A separator anywhere but at the end ties the rule to this directory
+		const bool anchored = line.find('/') != std::string_view::npos;
+
+		if (line.starts_with('/'))
+		{
+			line.remove_prefix(1);
+		}
+
+		if (line.empty())
+		{
+			continue;
+		}
+
+		const uint32_t number = static_cast<uint32_t>(_negated.size() + 1);
+		_negated.push_back(negated);
+
+		if (!has_wildcards(line))
+		{
+			record((anchored ? _paths : _names)[std::string(line)], number, directory_only);
+		}
+		else if (!anchored && line.starts_with("*.") && !has_wildcards(line.substr(1)) &&
+			line.find('.', 2) == std::string_view::npos)
+		{
+			record(_extensions[std::string(line.substr(2))], number, directory_only);
+		}
+		else
+		{
+			_globs.push_back({ std::string(line), number, anchored, directory_only });
+		}
+	}
+}
+
+ignore_matcher::verdict ignore_matcher::match(std::string_view path, bool is_directory) const
+{
+	const size_t separator = path.rfind('/');
+	const std::string_view name = separator == std::string_view::npos ? path : path.substr(separator + 1);
+	const size_t dot = name.rfind('.');
+
+	uint32_t number = std::max(lookup(_names, name, is_directory), lookup(_paths, path, is_directory));
+
+	if (dot != std::string_view::npos)
+	{
+		number = std::max(number, lookup(_extensions, name.substr(dot + 1), is_directory));
+	}
+
+	// Only the glob rules after the best match so far can still change it
+	for (auto iter = _globs.crbegin(); iter != _globs.crend() && iter->number > number; ++iter)
+	{
+		if ((is_directory || !iter->directory_only) && glob_match(iter->pattern, iter->anchored ? path : name))
+		{
+			number = iter->number;
+		}
+	}
+
+	if (!number)
+	{
+		return verdict::none;
+	}
+
+	return _negated[number - 1] ? verdict::include : verdict::ignore;
+}
+
+bool ignore_matcher::empty() const
+{
+	return _negated.empty();
+}
+
+void ignore_matcher::record(rule_numbers& numbers, uint32_t number, bool directory_only)
+{
+	(directory_only ? numbers.directory : numbers.any) = number;
+}
+
+uint32_t ignore_matcher::lookup(
+	const rule_map& rules,
+	std::string_view key,
+	bool is_directory)
+{
+	if (rules.empty())
+	{
+		return 0;
+	}
+
+	const auto iter = rules.find(key);
+
+	if (iter == rules.cend())
+	{
+		return 0;
+	}
+
+	return is_directory ? std::max(iter->second.any, iter->second.directory) : iter->second.any;
+}
+
+std::shared_ptr<const ignore_filter> ignore_filter::load(
+	const std::shared_ptr<const ignore_filter>& parent,
+	const std::filesystem::path& directory)
+{
+	ignore_matcher matcher;
+
+	for (std::string_view name : ignore_files)
+	{
+		std::ifstream file(directory / name, std::ios::binary);
+
+		if (file)
+		{
+			matcher.add_rules(std::string(std::istreambuf_iterator<char>(file), {}));
+		}
+	}
+
+	if (matcher.empty() && parent)
+	{
+		return parent;
+	}
+
+	return std::make_shared<const ignore_filter>(parent, directory, std::move(matcher));
+}
+
+ignore_filter::ignore_filter(
+	const std::shared_ptr<const ignore_filter>& parent,
+	const std::filesystem::path& directory,
+	ignore_matcher&& matcher) :
+	_parent(parent),
+	_prefix_size(directory.generic_string().size()),
+	_matcher(std::move(matcher))
+{
+	if (!directory.generic_string().ends_with('/'))
+	{
+		++_prefix_size;
+	}
+}
+
+bool ignore_filter::is_ignored(const std::filesystem::directory_entry& entry) const
+{
+	std::error_code error;
+	const bool is_directory = entry.is_directory(error);
+
+	if (is_directory && entry.path().filename() == ".git")
+	{
+		return true;
+	}
+
+	const std::string path = entry.path().generic_string();
+
+	// The rules closest to the entry take precedence
+	for (const ignore_filter* filter = this; filter; filter = filter->_parent.get())
+	{
+		if (path.size() <= filter->_prefix_size)
+		{
+			continue;
+		}
+
+		const auto verdict = filter->_matcher.match(std::string_view(path).substr(filter->_prefix_size), is_directory);
+
+		if (verdict != ignore_matcher::verdict::none)
+		{
+			return verdict == ignore_matcher::verdict::ignore;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The rules of the ignore files of one directory, compiled so that a path is
+// checked in about constant time however many rules there are: the rules for
+// a plain name, a file extension or a plain path are looked up in hash maps
+// and only the remaining glob rules are tried one by one. As in git the last
+// rule matching a path decides.
+class ignore_matcher
+{
+public:
+	enum class verdict
+	{
+		none,
+		ignore,
+		include
+	};
+
+	// Adds the rules of a file in the .gitignore format
+	void add_rules(std::string_view contents);
+
+	// The path is relative to the directory of the ignore files
+	verdict match(std::string_view path, bool is_directory) const;
+
+	bool empty() const;
+
+private:
+	// The highest numbered rule for a key, plus one, or zero if none
+	struct rule_numbers
+	{
+		uint32_t any = 0;
+		uint32_t directory = 0;
+	};
+
+	struct glob_rule
+	{
+		std::string pattern;
+		uint32_t number = 0;
+		bool anchored = false;
+		bool directory_only = false;
+	};
+
+	// Lets the maps be looked up by a string_view
+	struct key_hash
+	{
+		using is_transparent = void;
+
+		size_t operator()(std::string_view key) const
+		{
+			return std::hash<std::string_view>()(key);
+		}
+	};
+
+	using rule_map = std::unordered_map<std::string, rule_numbers, key_hash, std::equal_to<>>;
+
+	static void record(rule_numbers& numbers, uint32_t number, bool directory_only);
+	static uint32_t lookup(const rule_map& rules, std::string_view key, bool is_directory);
+
+	rule_map _names;
+	rule_map _extensions;
+	rule_map _paths;
+	std::vector<glob_rule> _globs;
+	std::vector<bool> _negated;
+};
+
+// The ignore rules in effect in a directory: those of its own .gitignore and
+// .ignore files, the latter taking precedence, then those of the directories
+// above it. The .git directory itself is always ignored.
+class ignore_filter
+{
+public:
+	// A directory without ignore files shares the filter of its parent
+	static std::shared_ptr<const ignore_filter> load(
+		const std::shared_ptr<const ignore_filter>& parent,
+		const std::filesystem::path& directory);
+
+	// The entry lies below the directory the filter was loaded for
+	bool is_ignored(const std::filesystem::directory_entry& entry) const;
+
+	ignore_filter(
+		const std::shared_ptr<const ignore_filter>& parent,
+		const std::filesystem::path& directory,
+		ignore_matcher&& matcher);
+
+private:
+	std::shared_ptr<const ignore_filter> _parent;
+
+	// The length of the directory path with a trailing separator
+	size_t _prefix_size;
+	ignore_matcher _matcher;
+};
@@ -1,119 +1,2138 @@
+#include "aho_corasick.hpp"
+#include "content_type.hpp"
+#include "decompressor.hpp"
+#include "file_filter.hpp"
+#include "fuzzy_search.hpp"
+#include "grep_regex.hpp"
+#include "ignore_filter.hpp"
+#include "memory_mapped_file.hpp"
+#include "output_writer.hpp"
+#include "plain_search.hpp"
+#include "result_cache.hpp"
+#include "search_stats.hpp"
+#include "thread_pool.hpp"
+#include "trigram_index.hpp"
+#include "utf16.hpp"
+
+#if defined(__linux__)
+#include "daemon_protocol.hpp"
+#include "file_watcher.hpp"
+#include "resident_tree.hpp"
+#include "uring_reader.hpp"
+
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 #include <algorithm>
-#include <array>
+#include <charconv>
+#include <csignal>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
-#include <map>
-#include <regex>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+struct text_line
+{
+	uint64_t number = 0;
+	size_t begin = 0;
+	size_t end = 0;
+};
+
+// Locates the lines around the hits of a scan moving forward through the
+// contents, the line feeds in between are counted only once
+class line_tracker
+{
+public:
+	explicit line_tracker(std::string_view contents) :
+		_contents(contents)
+	{
+	}
+
+	// The position must not precede the line of the previous one
+	text_line locate(size_t position)
+	{
+		const size_t begin = position ? _contents.rfind('\n', position - 1) + 1 : 0;
+		const size_t end = std::min(_contents.find('\n', position), _contents.size());
+
+		_number += static_cast<uint64_t>(
+			std::count(_contents.cbegin() + _counted, _contents.cbegin() + begin, '\n'));
+		_counted = begin;
 
-constexpr size_t buffer_size = 0x1000; // 4kib
+		return { _number, begin, end };
+	}
+
+private:
+	const std::string_view _contents;
+	uint64_t _number = 1;
+	size_t _counted = 0;
+};
 
-std::map<uint32_t, std::string> lines_containing(std::istream& input, std::string_view word)
+// The whole mapped file is searched for the needle and the enclosing line is
+// looked up only around a hit, non-matching lines cost nothing but the search.
+// The search stops once the callback returns false.
+template <typename F>
+void for_each_line_containing(std::string_view contents, const plain_searcher& searcher, F&& callback)
 {
-	std::map<uint32_t, std::string> results;
-	std::array<char, buffer_size> buffer = {};
+	line_tracker tracker(contents);
+	size_t offset = 0;
 
-	for (uint32_t line_number = 1; input.getline(buffer.data(), buffer_size, '\n'); ++line_number)
+	while (offset < contents.size())
 	{
-		const std::streamsize bytes_read = input.gcount();
+		const size_t position = searcher.find(contents, offset);
+
+		if (position == std::string_view::npos)
+		{
+			break;
+		}
+
+		const text_line line = tracker.locate(position);
+
+		// A needle with a line feed can span lines, which is not a match within a line
+		if (position + searcher.needle().size() > line.end)
+		{
+			offset = position + 1;
+			continue;
+		}
 
-		if (bytes_read <= 0)
+		if (!callback(line.number, contents.substr(line.begin, line.end - line.begin)))
 		{
 			break;
 		}
 
-		const std::string_view view(buffer.data(), static_cast<size_t>(bytes_read));
+		offset = line.end + 1;
+	}
+}
+
+// Stops once the callback returns false
+template <typename F>
+void for_each_line(std::string_view contents, F&& callback)
+{
+	uint64_t line_number = 1;
+
+	for (size_t offset = 0; offset < contents.size(); ++line_number)
+	{
+		const size_t line_end = std::min(contents.find('\n', offset), contents.size());
 
-		if (view.find(word) != std::string::npos)
+		if (!callback(line_number, contents.substr(offset, line_end - offset)))
 		{
-			results.emplace(line_number, view);
+			break;
 		}
+
+		offset = line_end + 1;
 	}
+}
 
-	return results;
+void lines_containing(std::string_view contents, const plain_searcher& searcher, line_sink& sink)
+{
+	for_each_line_containing(contents, searcher, [&](uint64_t line_number, std::string_view line)
+	{
+		return sink.line(line_number, line);
+	});
 }
 
-std::map<uint32_t, std::string> lines_matching(std::istream& input, const std::regex& regex)
+// The contents are UTF-16LE after the byte order mark and so are the units of
+// the needle, which the same kernels find a byte at a time. A hit that does
+// not start on a code unit is passed over, and ignoring the case a hit is
+// checked unit by unit, since the kernels fold the high bytes as well. Only
+// the matching lines are converted to UTF-8 for the output.
+void lines_containing_utf16(
+		std::string_view contents,
+		const plain_searcher& searcher,
+		const std::string& needle,
+		bool ignore_case,
+		line_sink& sink)
 {
-	std::map<uint32_t, std::string> results;
-	std::array<char, buffer_size> buffer = {};
+	uint64_t line_number = 1;
+	size_t counted = 0;
 
-	for (uint32_t line_number = 1; input.getline(buffer.data(), buffer_size, '\n'); ++line_number)
+	for (size_t offset = 2; offset < contents.size();)
 	{
-		const std::streamsize bytes_read = input.gcount();
+		const size_t position = searcher.find(contents, offset);
 
-		if (bytes_read <= 0)
+		if (position == std::string_view::npos)
 		{
 			break;
 		}
 
-		const std::string_view view(buffer.data(), static_cast<size_t>(bytes_read));
+		if (position % 2 || (ignore_case && !utf16_equal_ignoring_case(contents.substr(position, needle.size()), needle)))
+		{
+			offset = position + 1;
+			continue;
+		}
+
+		const size_t begin = std::max(utf16_line_begin(contents, position), size_t(2));
+		const size_t end = utf16_line_end(contents, position);
 
-		if (std::regex_search(view.cbegin(), view.cend(), regex))
+		// A needle with a line feed can span lines, which is not a match within a line
+		if (position + needle.size() > end)
 		{
-			results.emplace(line_number, view);
+			offset = position + 2;
+			continue;
 		}
-	}
 
-	return results;
+		line_number += utf16_count_lines(contents, counted, begin);
+		counted = begin;
+
+		if (!sink.line(line_number, utf16_to_utf8(contents.substr(begin, end - begin))))
+		{
+			break;
+		}
+
+		offset = end + 2;
+	}
 }
 
-void search(
-		const std::filesystem::path& path,
-		const std::function<std::map<uint32_t, std::string>(std::istream&)>& search_function)
+// With a prefilter for a literal the expression requires, only the lines
+// containing the literal are matched against the expression
+void lines_matching(
+		std::string_view contents,
+		const grep_regex& regex,
+		const std::optional<plain_searcher>& prefilter,
+		line_sink& sink)
 {
-	for (const auto& iter : std::filesystem::recursive_directory_iterator(path))
+	if (prefilter)
+	{
+		for_each_line_containing(contents, *prefilter, [&](uint64_t line_number, std::string_view line)
+		{
+			return !regex.search(line) || sink.line(line_number, line);
+		});
+
+		return;
+	}
+
+	for_each_line(contents, [&](uint64_t line_number, std::string_view line)
 	{
-		const std::filesystem::path& file_path = iter.path();
+		return !regex.search(line) || sink.line(line_number, line);
+	});
+}
 
-		try
+// When the pattern has pieces one of which a match keeps intact, each piece
+// is looked for with the vector kernels and only the lines with a piece are
+// run through the bit-parallel search
+void lines_resembling(
+		std::string_view contents,
+		const fuzzy_searcher& searcher,
+		const std::vector<plain_searcher>& pieces,
+		line_sink& sink)
+{
+	if (pieces.empty())
+	{
+		for_each_line(contents, [&](uint64_t line_number, std::string_view line)
 		{
-			std::ifstream file(file_path);
+			return !searcher.search(line) || sink.line(line_number, line);
+		});
+
+		return;
+	}
+
+	// The next occurrence of each piece, found again once passed
+	std::vector<size_t> next(pieces.size());
+
+	for (size_t i = 0; i < pieces.size(); ++i)
+	{
+		next[i] = pieces[i].find(contents);
+	}
+
+	line_tracker tracker(contents);
+
+	for (size_t offset = 0; offset < contents.size();)
+	{
+		size_t position = std::string_view::npos;
 
-			for (const auto& [line_number, line] : search_function(file))
+		for (size_t i = 0; i < pieces.size(); ++i)
+		{
+			if (next[i] < offset)
 			{
-				std::cout << file_path << ':' << line_number << ':' << line << std::endl;
+				next[i] = pieces[i].find(contents, offset);
 			}
+
+			position = std::min(position, next[i]);
 		}
-		catch (const std::exception& e)
+
+		if (position == std::string_view::npos)
+		{
+			break;
+		}
+
+		const text_line line = tracker.locate(position);
+		const std::string_view text = contents.substr(line.begin, line.end - line.begin);
+
+		if (searcher.search(text) && !sink.line(line.number, text))
 		{
-			std::cerr << "Failed to process: " << file_path << ": " << e.what() << std::endl;
+			break;
 		}
+
+		offset = line.end + 1;
 	}
 }
 
-void print_usage(const std::filesystem::path& executable)
+// Reports each line containing any of the patterns once, labelled with the
+// pattern found first on it
+void lines_containing_any(std::string_view contents, const aho_corasick& automaton, line_sink& sink)
 {
-	std::cout << "Usage: " << executable << " <folder> <mode> <expression>" << std::endl;
+	line_tracker tracker(contents);
+
+	for (size_t offset = 0; offset < contents.size();)
+	{
+		const auto match = automaton.find(contents, offset);
+
+		if (!match)
+		{
+			break;
+		}
+
+		const text_line line = tracker.locate(match->begin);
+
+		if (!sink.line(line.number, automaton.pattern(match->pattern), contents.substr(line.begin, line.end - line.begin)))
+		{
+			break;
+		}
+
+		offset = line.end + 1;
+	}
 }
 
-int main(int argc, char** argv)
+std::vector<std::string> read_patterns(const std::filesystem::path& path)
 {
-	if (argc < 4)
+	std::ifstream file(path);
+
+	if (!file)
 	{
-		print_usage(argv[0]);
-		return EINVAL;
+		throw std::system_error(errno, std::system_category(), path.string());
 	}
 
-	const std::filesystem::path path(argv[1]);
-	const std::string mode(argv[2]);
+	std::vector<std::string> patterns;
 
-	if (mode == "plain")
+	for (std::string line; std::getline(file, line);)
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+
+		if (!line.empty())
+		{
+			patterns.emplace_back(std::move(line));
+		}
+	}
+
+	return patterns;
+}
+
+// Searches the contents of a file and streams the matching lines to the sink
+using line_search_function = std::function<void(std::string_view, line_sink&)>;
+
+// How each file is searched
+struct search_settings
+{
+	line_search_function search_function;
+	bool search_binary = false;
+
+	// Which of the regular files the walk comes across are searched
+	file_filter metadata_filter;
+
+	// Searches the files with a UTF-16LE byte order mark, which are skipped
+	// as binary without it
+	line_search_function utf16_search_function;
+
+	// Files larger than the threshold are cut into chunks at line feeds and
+	// the chunks are searched on the chunk pool, if there is one. It may be
+	// the pool searching the files, the chunks are waited for by helping.
+	size_t split_threshold = 0;
+	thread_pool* chunk_pool = nullptr;
+
+	// The lines written around each matching line
+	uint32_t before_context = 0;
+	uint32_t after_context = 0;
+
+	// Counts what the search goes through, if wanted
+	search_stats* stats = nullptr;
+
+	// Keeps the results of each file for a repeat of the query, if wanted
+	result_cache* cache = nullptr;
+};
+
+// Searches for the text, in UTF-16 files as well if it is valid UTF-8
+void set_up_plain(search_settings& settings, const std::string& text, bool ignore_case)
+{
+	const plain_searcher searcher(text, ignore_case);
+	settings.search_function = std::bind(lines_containing, std::placeholders::_1, searcher, std::placeholders::_2);
+
+	if (const std::optional<std::string> needle = utf8_to_utf16(text))
 	{
-		const std::string search_word(argv[3]);
-		search(path, std::bind(lines_containing, std::placeholders::_1, search_word));
+		settings.utf16_search_function = std::bind(
+			lines_containing_utf16,
+			std::placeholders::_1,
+			plain_searcher(*needle, ignore_case),
+			*needle,
+			ignore_case,
+			std::placeholders::_2);
 	}
-	else if(mode == "regex")
+}
+
+// Searches for the expression, ignoring the case, and returns the literal the
+// index can be looked up by. Throws std::regex_error if it is not valid.
+std::string set_up_regex(search_settings& settings, const std::string& expression)
+{
+	const grep_regex regex(expression, true);
+	std::optional<plain_searcher> prefilter;
+
+	if (!regex.required_literal().empty())
+	{
+		prefilter.emplace(regex.required_literal(), true);
+	}
+
+	settings.search_function = std::bind(lines_matching, std::placeholders::_1, regex, prefilter, std::placeholders::_2);
+	return std::string(regex.required_literal());
+}
+
+// The matches of a chunk of a file, numbered from the start of the chunk
+// until the lines before it are known
+class chunk_sink : public line_sink
+{
+public:
+	struct match
+	{
+		uint64_t number = 0;
+		std::string_view label;
+		std::string_view text;
+	};
+
+	bool line(uint64_t number, std::string_view text) override
+	{
+		matches.push_back({ number, {}, text });
+		return true;
+	}
+
+	bool line(uint64_t number, std::string_view label, std::string_view text) override
+	{
+		matches.push_back({ number, label, text });
+		return true;
+	}
+
+	std::vector<match> matches;
+};
+
+// A window of chunks, one for each thread of the pool, is searched at a time.
+// Once all of them are done, their matches are renumbered by the line feeds of
+// the chunks before them and passed on in order, so only the matches of one
+// window are ever held.
+void search_chunks(std::string_view contents, const search_settings& settings, line_sink& sink)
+{
+	constexpr size_t chunk_size = 0x800000; // 8 MiB
+
+	thread_pool& pool = *settings.chunk_pool;
+	uint64_t lines_before = 0;
+
+	for (size_t offset = 0; offset < contents.size();)
+	{
+		std::vector<std::string_view> chunks;
+
+		while (chunks.size() < pool.size() && offset < contents.size())
+		{
+			size_t end = std::min(offset + chunk_size, contents.size());
+
+			if (end < contents.size())
+			{
+				end = std::min(contents.find('\n', end), contents.size() - 1) + 1;
+			}
+
+			chunks.push_back(contents.substr(offset, end - offset));
+			offset = end;
+		}
+
+		std::vector<chunk_sink> sinks(chunks.size());
+		std::vector<uint64_t> line_feeds(chunks.size());
+		std::vector<std::exception_ptr> errors(chunks.size());
+		std::latch done(static_cast<std::ptrdiff_t>(chunks.size()));
+
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			pool.submit([&, i]()
+			{
+				try
+				{
+					settings.search_function(chunks[i], sinks[i]);
+					line_feeds[i] = static_cast<uint64_t>(std::count(chunks[i].cbegin(), chunks[i].cend(), '\n'));
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+
+				done.count_down();
+			});
+		}
+
+		// The pool is the one the files are searched on as well
+		pool.help_until(done);
+
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			if (errors[i])
+			{
+				std::rethrow_exception(errors[i]);
+			}
+
+			for (const chunk_sink::match& match : sinks[i].matches)
+			{
+				const bool more = match.label.empty() ?
+					sink.line(lines_before + match.number, match.text) :
+					sink.line(lines_before + match.number, match.label, match.text);
+
+				if (!more)
+				{
+					return;
+				}
+			}
+
+			lines_before += line_feeds[i];
+		}
+	}
+}
+
+std::mutex error_mutex;
+
+void report_failure(const std::filesystem::path& path, const std::exception& e)
+{
+	std::lock_guard<std::mutex> lock(error_mutex);
+	std::cerr << "Failed to process: " << path << ": " << e.what() << std::endl;
+}
+
+// Huge contents are searched in chunks
+void find_lines(std::string_view contents, const search_settings& settings, line_sink& sink)
+{
+	if (settings.chunk_pool && contents.size() > settings.split_threshold)
 	{
-		const std::regex regex(argv[3], std::regex::grep | std::regex::icase);
-		search(path, std::bind(lines_matching, std::placeholders::_1, regex));
+		search_chunks(contents, settings, sink);
 	}
 	else
 	{
-		print_usage(argv[0]);
-		return EINVAL;
+		settings.search_function(contents, sink);
+	}
+}
+
+// Passes the matches of a search started further into the contents on,
+// numbered from their start
+class numbered_sink : public line_sink
+{
+public:
+	numbered_sink(line_sink& sink, uint64_t lines_before) :
+		_sink(sink),
+		_lines_before(lines_before)
+	{
+	}
+
+	bool line(uint64_t number, std::string_view text) override
+	{
+		_stopped = !_sink.line(_lines_before + number, text);
+		return !_stopped;
+	}
+
+	bool line(uint64_t number, std::string_view label, std::string_view text) override
+	{
+		_stopped = !_sink.line(_lines_before + number, label, text);
+		return !_stopped;
+	}
+
+	// Whether the sink wanted no more
+	bool stopped() const
+	{
+		return _stopped;
+	}
+
+private:
+	line_sink& _sink;
+	const uint64_t _lines_before;
+	bool _stopped = false;
+};
+
+// The decompressed contents are searched as they come, a window of whole lines
+// at a time: the lines kept for the context of the next match, then the new
+// ones. The decompressor fills the next blocks on its own thread meanwhile,
+// and only the window and its blocks are ever held.
+void search_compressed(
+		std::string_view contents,
+		compression format,
+		const search_settings& settings,
+		match_sink& sink)
+{
+	const bool with_context = (settings.before_context || settings.after_context) &&
+		sink.what() == output_writer::report::lines;
+
+	decompressor stream(contents, format);
+	context_sink context(sink, {}, settings.before_context, settings.after_context);
+	line_sink& target = with_context ? static_cast<line_sink&>(context) : sink;
+
+	std::string window;
+
+	// The lines kept at the start of the window and the number of the first
+	size_t kept_size = 0;
+	uint64_t kept_number = 1;
+
+	// The number of the first line not searched yet
+	uint64_t next_number = 1;
+
+	for (bool done = false, checked = false; !done;)
+	{
+		std::string_view block;
+
+		{
+			phase_timer timer(settings.stats, search_stats::read);
+			block = stream.next();
+		}
+
+		done = block.empty();
+		window.append(block);
+
+		// The last line goes without a line feed only at the end
+		size_t end = window.size();
+
+		if (!done)
+		{
+			end = window.rfind('\n');
+
+			if (end == std::string::npos || end < kept_size)
+			{
+				continue;
+			}
+
+			++end;
+		}
+
+		const std::string_view lines(window.data(), end);
+		const std::string_view fresh = lines.substr(kept_size);
+
+		if (!checked)
+		{
+			checked = true;
+
+			if (!settings.search_binary && looks_binary(fresh))
+			{
+				if (settings.stats)
+				{
+					++settings.stats->local().files_binary;
+				}
+
+				return;
+			}
+		}
+
+		if (settings.stats)
+		{
+			settings.stats->local().bytes_scanned += fresh.size();
+		}
+
+		phase_timer timer(settings.stats, search_stats::match);
+
+		if (with_context)
+		{
+			context.move_on(lines, kept_number);
+		}
+
+		numbered_sink numbered(target, next_number - 1);
+		find_lines(fresh, settings, numbered);
+
+		if (with_context)
+		{
+			context.finish();
+		}
+
+		if (numbered.stopped())
+		{
+			return;
+		}
+
+		next_number += static_cast<uint64_t>(std::count(fresh.cbegin(), fresh.cend(), '\n'));
+
+		// Back over the lines the next match may want before it
+		size_t kept_begin = end;
+		uint32_t kept_count = 0;
+
+		while (kept_count < settings.before_context && kept_begin > 0)
+		{
+			kept_begin = kept_begin > 1 ? lines.rfind('\n', kept_begin - 2) + 1 : 0;
+			++kept_count;
+		}
+
+		kept_size = end - kept_begin;
+		kept_number = next_number - kept_count;
+		window.erase(0, kept_begin);
+	}
+}
+
+// The context lines are taken from the contents, which are still at hand.
+// Compressed contents are searched decompressed, if the format is built in.
+void search_contents(std::string_view contents, const search_settings& settings, match_sink& sink)
+{
+	const compression format = detect_compression(contents);
+
+	if (format != compression::none && can_decompress(format))
+	{
+		search_compressed(contents, format, settings, sink);
+		return;
+	}
+
+	// The lines of UTF-16 are converted for the output, so there are no
+	// contents to take the context from
+	if (settings.utf16_search_function && has_utf16_bom(contents))
+	{
+		if (settings.stats)
+		{
+			settings.stats->local().bytes_scanned += contents.size();
+		}
+
+		phase_timer timer(settings.stats, search_stats::match);
+		settings.utf16_search_function(contents, sink);
+		return;
+	}
+
+	// Binary files are passed over after a look at their first block
+	if (!settings.search_binary && looks_binary(contents))
+	{
+		if (settings.stats)
+		{
+			++settings.stats->local().files_binary;
+		}
+
+		return;
+	}
+
+	if (settings.stats)
+	{
+		settings.stats->local().bytes_scanned += contents.size();
+	}
+
+	phase_timer timer(settings.stats, search_stats::match);
+
+	if ((!settings.before_context && !settings.after_context) || sink.what() != output_writer::report::lines)
+	{
+		find_lines(contents, settings, sink);
+		return;
+	}
+
+	context_sink context(sink, contents, settings.before_context, settings.after_context);
+	find_lines(contents, settings, context);
+	context.finish();
+}
+
+// Keeps the results of a file searched anew, unless the search failed
+void store_results(
+		const std::filesystem::path& file_path,
+		const std::optional<result_cache::file_key>& key,
+		const search_settings& settings,
+		const match_sink& sink,
+		bool failed)
+{
+	if (key && !failed && sink.copy())
+	{
+		settings.cache->store(file_path, *key, *sink.copy());
+	}
+}
+
+// Searches the file mapped, its key is the one the cache took if there is one
+void map_and_search(
+		const std::filesystem::path& file_path,
+		const std::optional<result_cache::file_key>& key,
+		const search_settings& settings,
+		output_writer& output,
+		const output_writer::slot& slot)
+{
+	match_sink sink(output, slot, file_path);
+	bool failed = false;
+
+	if (key)
+	{
+		sink.keep_copy(result_cache::max_results_size);
+	}
+
+	try
+	{
+		std::unique_ptr<memory_mapped_file> file;
+
+		{
+			phase_timer timer(settings.stats, search_stats::read);
+			file = std::make_unique<memory_mapped_file>(file_path);
+		}
+
+		search_contents(file->data(), settings, sink);
+	}
+	catch (const std::exception& e)
+	{
+		report_failure(file_path, e);
+		failed = true;
+	}
+
+	sink.close();
+	store_results(file_path, key, settings, sink, failed);
+}
+
+// Looks the file up in the cache if there is one, the stat it takes counts
+// as reading
+std::optional<std::string> lookup_cached(
+		const std::filesystem::path& file_path,
+		const search_settings& settings,
+		std::optional<result_cache::file_key>& key)
+{
+	if (!settings.cache)
+	{
+		return {};
+	}
+
+	phase_timer timer(settings.stats, search_stats::read);
+	std::optional<std::string> results = settings.cache->lookup(file_path, key);
+
+	if (results && settings.stats)
+	{
+		++settings.stats->local().files_cached;
+	}
+
+	return results;
+}
+
+void search_file(
+		const std::filesystem::path& file_path,
+		const search_settings& settings,
+		output_writer& output,
+		const output_writer::slot& slot = {})
+{
+	// Nothing more gets written once a write failed
+	if (output.failed())
+	{
+		output.complete(slot, {});
+		return;
+	}
+
+	if (settings.stats)
+	{
+		++settings.stats->local().files_visited;
+	}
+
+	std::optional<result_cache::file_key> key;
+	std::optional<std::string> cached = lookup_cached(file_path, settings, key);
+
+	if (cached)
+	{
+		output.complete(slot, std::move(*cached));
+		return;
+	}
+
+	map_and_search(file_path, key, settings, output, slot);
+}
+
+// Searches the files of a sequential walk in turn, given their size when the
+// walk has it at hand, and returns whether the walk should go on
+using file_visitor = std::function<bool(const std::filesystem::path&, std::optional<uint64_t>)>;
+
+#if defined(__linux__)
+// Keeps the reads of the files coming up in the walk in flight while the one
+// before them is searched. The files are searched in the order they are
+// visited, a file the reader could not take in whole is mapped as usual. A
+// file known to be too large for it is mapped right away, without a slot.
+// Files served from the cache are not read at all.
+class read_ahead
+{
+public:
+	read_ahead(uring_reader& reader, const search_settings& settings, output_writer& output) :
+		_reader(reader),
+		_settings(settings),
+		_output(output)
+	{
+	}
+
+	bool visit(const std::filesystem::path& file_path, std::optional<uint64_t> size = {})
+	{
+		// Cached files take no slot, but there are only so many of them kept
+		// waiting behind a read
+		constexpr size_t max_pending = 0x1000;
+
+		while (!_pending.empty() && (_reader.full() || _pending.size() >= max_pending))
+		{
+			search_next();
+		}
+
+		if (_settings.stats)
+		{
+			++_settings.stats->local().files_visited;
+		}
+
+		pending_file file;
+		file.path = file_path;
+		file.cached = lookup_cached(file_path, _settings, file.key);
+
+		if (file.key)
+		{
+			size = file.key->size;
+		}
+
+		file.mapped = size && *size >= _reader.buffer_size();
+
+		if (!file.cached && !file.mapped)
+		{
+			file.slot = _reader.read(file_path);
+		}
+
+		_pending.push_back(std::move(file));
+		return !_output.failed();
+	}
+
+	// Searches the files still pending
+	void finish()
+	{
+		while (!_pending.empty())
+		{
+			search_next();
+		}
+	}
+
+private:
+	read_ahead(const read_ahead&) = delete;
+	read_ahead(read_ahead&&) = delete;
+	read_ahead& operator = (const read_ahead&) = delete;
+	read_ahead& operator = (read_ahead&&) = delete;
+
+	struct pending_file
+	{
+		std::filesystem::path path;
+		std::optional<result_cache::file_key> key;
+		std::optional<std::string> cached;
+		bool mapped = false;
+		unsigned slot = 0;
+	};
+
+	void search_next()
+	{
+		pending_file& file = _pending.front();
+
+		if (file.cached)
+		{
+			_output.complete({}, std::move(*file.cached));
+			_pending.pop_front();
+			return;
+		}
+
+		if (file.mapped)
+		{
+			map_and_search(file.path, file.key, _settings, _output, {});
+			_pending.pop_front();
+			return;
+		}
+
+		uring_reader::result result;
+
+		try
+		{
+			phase_timer timer(_settings.stats, search_stats::read);
+			result = _reader.wait(file.slot);
+		}
+		catch (const std::exception&)
+		{
+			// The ring failed, the file is read the usual way
+		}
+
+		if (result.complete)
+		{
+			match_sink sink(_output, {}, file.path);
+			bool failed = false;
+
+			if (file.key)
+			{
+				sink.keep_copy(result_cache::max_results_size);
+			}
+
+			try
+			{
+				search_contents(result.contents, _settings, sink);
+			}
+			catch (const std::exception& e)
+			{
+				report_failure(file.path, e);
+				failed = true;
+			}
+
+			sink.close();
+			store_results(file.path, file.key, _settings, sink, failed);
+		}
+		else
+		{
+			map_and_search(file.path, file.key, _settings, _output, {});
+		}
+
+		_reader.release(file.slot);
+		_pending.pop_front();
+	}
+
+	uring_reader& _reader;
+	const search_settings& _settings;
+	output_writer& _output;
+	std::deque<pending_file> _pending;
+};
+#endif
+
+// Visits the files of the directory, whose entries are at the depth, and goes
+// down into its subdirectories as it meets them. A directory that cannot be
+// read is reported and passed over, as the parallel walk does. Returns false
+// once a visit stops the walk.
+bool walk_directory(
+		const std::filesystem::path& path,
+		size_t depth,
+		const std::shared_ptr<const ignore_filter>& ignores,
+		const file_filter& metadata_filter,
+		const file_visitor& visit,
+		search_stats* stats)
+{
+	std::error_code error;
+	std::filesystem::directory_iterator iter(path, error);
+
+	for (const std::filesystem::directory_iterator end; !error && iter != end; iter.increment(error))
+	{
+		const std::filesystem::directory_entry& entry = *iter;
+
+		if (ignores && ignores->is_ignored(entry))
+		{
+			if (stats && !entry.is_directory())
+			{
+				++stats->local().files_ignored;
+			}
+
+			continue;
+		}
+
+		if (entry.is_directory())
+		{
+			if (!entry.is_symlink() && metadata_filter.enters(depth) && !walk_directory(
+					entry.path(),
+					depth + 1,
+					ignores ? ignore_filter::load(ignores, entry.path()) : nullptr,
+					metadata_filter,
+					visit,
+					stats))
+			{
+				return false;
+			}
+		}
+		else if (entry.is_regular_file() && !trigram_index::is_index_file(entry.path()))
+		{
+			std::optional<uint64_t> size;
+
+			if (!metadata_filter.admits(entry, depth, &size))
+			{
+				if (stats)
+				{
+					++stats->local().files_filtered;
+				}
+
+				continue;
+			}
+
+			if (!visit(entry.path(), size))
+			{
+				return false;
+			}
+		}
+	}
+
+	if (error)
+	{
+		report_failure(path, std::filesystem::filesystem_error("cannot list the directory", path, error));
+	}
+
+	return true;
+}
+
+// Without a filter every file is searched. With one, the ignored entries are
+// passed over and the ignored directories are not even entered. Only regular
+// files are visited, those the metadata filter admits, and the type of each
+// entry is the one the listing cached.
+void search(
+		const std::filesystem::path& path,
+		const std::shared_ptr<const ignore_filter>& ignores,
+		const file_filter& metadata_filter,
+		const file_visitor& visit,
+		search_stats* stats)
+{
+	// The files visited take their time out of the walk's
+	phase_timer timer(stats, search_stats::walk);
+
+	walk_directory(path, 0, ignores, metadata_filter, visit, stats);
+}
+
+// Every directory is enumerated by its own task and every file found is
+// scanned by its own task, so both spread across the pool's workers. The
+// ignore files of a directory are read by its own task as well. The entries
+// to visit are listed before any is submitted, so that they get their slots
+// of the output in the order of the walk.
+void search_directory(
+		thread_pool& pool,
+		const std::filesystem::path& path,
+		size_t depth,
+		const output_writer::slot& slot,
+		const std::shared_ptr<const ignore_filter>& ignores,
+		const search_settings& settings,
+		output_writer& output)
+{
+	if (output.failed())
+	{
+		output.complete(slot, {});
+		return;
+	}
+
+	std::vector<std::filesystem::directory_entry> entries;
+
+	try
+	{
+		phase_timer timer(settings.stats, search_stats::walk);
+
+		for (const auto& entry : std::filesystem::directory_iterator(path))
+		{
+			if (ignores && ignores->is_ignored(entry))
+			{
+				if (settings.stats && !entry.is_directory())
+				{
+					++settings.stats->local().files_ignored;
+				}
+
+				continue;
+			}
+
+			if (entry.is_directory())
+			{
+				if (!entry.is_symlink() && settings.metadata_filter.enters(depth))
+				{
+					entries.push_back(entry);
+				}
+			}
+			else if (entry.is_regular_file() && !trigram_index::is_index_file(entry.path()))
+			{
+				if (settings.metadata_filter.admits(entry, depth))
+				{
+					entries.push_back(entry);
+				}
+				else if (settings.stats)
+				{
+					++settings.stats->local().files_filtered;
+				}
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		report_failure(path, e);
+		output.complete(slot, {});
+		return;
+	}
+
+	output_writer::directory* listing = output.list(slot, entries.size());
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const output_writer::slot entry_slot = { listing, i };
+
+		if (entries[i].is_directory())
+		{
+			pool.submit([&pool, directory_path = entries[i].path(), depth, entry_slot, ignores, &settings, &output]()
+			{
+				search_directory(
+					pool,
+					directory_path,
+					depth + 1,
+					entry_slot,
+					ignores ? ignore_filter::load(ignores, directory_path) : nullptr,
+					settings,
+					output);
+			});
+		}
+		else
+		{
+			pool.submit([file_path = entries[i].path(), entry_slot, &settings, &output]()
+			{
+				search_file(file_path, settings, output, entry_slot);
+			});
+		}
+	}
+}
+
+void parallel_search(
+		thread_pool& pool,
+		const std::filesystem::path& path,
+		const std::shared_ptr<const ignore_filter>& ignores,
+		const search_settings& settings,
+		output_writer& output)
+{
+	pool.submit([&]()
+	{
+		search_directory(pool, path, 0, output.root(), ignores, settings, output);
+	});
+
+	pool.wait();
+}
+
+// Only the files the index lists as candidates for the literal are searched,
+// and those it does not hold as they are now. Which files there are is what
+// the walk finds, with the ignore files and the metadata filter, so files
+// created or changed since the index was written are not missed. They are
+// searched on the pool if there is one, else visited in turn.
+void indexed_search(
+		thread_pool* pool,
+		const std::filesystem::path& path,
+		const std::shared_ptr<const ignore_filter>& ignores,
+		std::string_view literal,
+		const search_settings& settings,
+		output_writer& output,
+		const file_visitor& visit)
+{
+	std::vector<std::filesystem::path> candidates;
+
+	{
+		const trigram_index index(path);
+
+		search(path, ignores, settings.metadata_filter, [&](const std::filesystem::path& file_path, std::optional<uint64_t>)
+		{
+			candidates.push_back(file_path);
+			return true;
+		}, settings.stats);
+
+		phase_timer timer(settings.stats, search_stats::walk);
+		candidates = index.candidates(literal, candidates);
+	}
+
+	if (!pool)
+	{
+		for (const auto& file_path : candidates)
+		{
+			if (!visit(file_path, {}))
+			{
+				break;
+			}
+		}
+
+		return;
+	}
+
+	output_writer::directory* listing = output.list(output.root(), candidates.size());
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		pool->submit([&file_path = candidates[i], slot = output_writer::slot{ listing, i }, &settings, &output]()
+		{
+			search_file(file_path, settings, output, slot);
+		});
+	}
+
+	pool->wait();
+}
+
+#if defined(__linux__)
+std::unique_ptr<file_watcher> watcher;
+
+void stop_watching(int)
+{
+	if (watcher)
+	{
+		watcher->stop();
+	}
+}
+
+// Brings the index up to date with whatever changed while nobody watched,
+// then folds every batch of changes into it until interrupted
+void watch_index(const std::filesystem::path& folder, bool use_ignore_files, size_t thread_count)
+{
+	try
+	{
+		trigram_index::update(folder, { folder }, use_ignore_files, thread_count);
+	}
+	catch (const std::exception&)
+	{
+		trigram_index::build(folder, use_ignore_files, thread_count);
+	}
+
+	std::signal(SIGINT, stop_watching);
+	std::signal(SIGTERM, stop_watching);
+
+	watcher = std::make_unique<file_watcher>(folder);
+	watcher->watch_tree([&](const std::vector<std::filesystem::path>& changes)
+	{
+		try
+		{
+			trigram_index::update(folder, changes, use_ignore_files, thread_count);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to update the index: " << e.what() << std::endl;
+		}
+	});
+}
+
+volatile std::sig_atomic_t serving = 1;
+
+void stop_serving(int signal)
+{
+	serving = 0;
+	stop_watching(signal);
+}
+
+// Searches the listed files for the query of a client and writes the results
+// to it. With an index, only the listed files it has as candidates are
+// searched; empty files are never opened. A single thread reads ahead if it
+// has a reader.
+void answer_query(
+		int socket,
+		const resident_tree& tree,
+		const std::shared_ptr<const trigram_index>& index,
+		thread_pool* pool,
+		uring_reader* reader)
+{
+	daemon_query query;
+
+	if (!receive_query(socket, query))
+	{
+		return;
+	}
+
+	search_settings settings;
+	std::string literal;
+
+	try
+	{
+		if (query.mode == daemon_query::search_mode::plain)
+		{
+			set_up_plain(settings, query.expression, query.ignore_case);
+			literal = query.expression;
+		}
+		else
+		{
+			literal = set_up_regex(settings, query.expression);
+		}
+	}
+	catch (const std::regex_error& e)
+	{
+		send_status(socket, EINVAL, std::string("Invalid expression: ") + e.what());
+		return;
+	}
+
+	settings.search_binary = query.search_binary;
+	settings.before_context = query.before_context;
+	settings.after_context = query.after_context;
+
+	const std::shared_ptr<const resident_tree::listing> files = tree.snapshot();
+	std::vector<const resident_tree::file*> selected;
+
+	if (index && !literal.empty())
+	{
+		// The candidates are looked up in the listing, which is in the order
+		// of the paths, rather than the whole listing in the candidates
+		std::vector<size_t> found;
+
+		for (const auto& file_path : index->candidates(literal))
+		{
+			const auto iter = std::lower_bound(files->cbegin(), files->cend(), file_path.native(),
+				[](const resident_tree::file& file, const std::string& path)
+				{
+					return file.path.native() < path;
+				});
+
+			if (iter != files->cend() && iter->path == file_path && iter->size)
+			{
+				found.push_back(static_cast<size_t>(iter - files->cbegin()));
+			}
+		}
+
+		std::sort(found.begin(), found.end());
+
+		for (const size_t i : found)
+		{
+			selected.push_back(&(*files)[i]);
+		}
+	}
+	else
+	{
+		for (const resident_tree::file& file : *files)
+		{
+			if (file.size)
+			{
+				selected.push_back(&file);
+			}
+		}
+	}
+
+	send_status(socket, 0);
+
+	output_writer output(true, query.report, nullptr, socket);
+
+	if (!pool && reader)
+	{
+		read_ahead ahead(*reader, settings, output);
+
+		for (const resident_tree::file* file : selected)
+		{
+			if (!ahead.visit(file->path, file->size))
+			{
+				break;
+			}
+		}
+
+		ahead.finish();
+	}
+	else if (!pool)
+	{
+		for (const resident_tree::file* file : selected)
+		{
+			if (output.failed())
+			{
+				break;
+			}
+
+			search_file(file->path, settings, output);
+		}
+	}
+	else
+	{
+		output_writer::directory* listing = output.list(output.root(), selected.size());
+
+		for (size_t i = 0; i < selected.size(); ++i)
+		{
+			pool->submit([file = selected[i], slot = output_writer::slot{ listing, i }, &settings, &output]()
+			{
+				search_file(file->path, settings, output, slot);
+			});
+		}
+
+		pool->wait();
+	}
+
+	output.flush();
+}
+
+// Keeps the listing of the folder, and its index if wanted, in memory and up
+// to date with its changes, and answers the queries of the clients at the
+// socket one at a time until interrupted
+void serve(
+		const std::filesystem::path& folder,
+		const std::filesystem::path& socket_path,
+		bool use_ignore_files,
+		bool use_index,
+		const file_filter& metadata_filter,
+		size_t thread_count,
+		unsigned queue_depth)
+{
+	std::mutex index_mutex;
+	std::shared_ptr<const trigram_index> index;
+
+	if (use_index)
+	{
+		try
+		{
+			trigram_index::update(folder, { folder }, use_ignore_files, thread_count);
+		}
+		catch (const std::exception&)
+		{
+			trigram_index::build(folder, use_ignore_files, thread_count);
+		}
+
+		index = std::make_shared<trigram_index>(folder);
+	}
+
+	resident_tree tree(folder, use_ignore_files, metadata_filter);
+	const int listener = listen_at(socket_path);
+
+	std::signal(SIGINT, stop_serving);
+	std::signal(SIGTERM, stop_serving);
+
+	// A client gone before its results are written fails the write instead
+	std::signal(SIGPIPE, SIG_IGN);
+
+	watcher = std::make_unique<file_watcher>(folder);
+
+	std::thread refresher([&]()
+	{
+		try
+		{
+			watcher->watch_tree([&](const std::vector<std::filesystem::path>& changes)
+			{
+				try
+				{
+					tree.update(changes);
+
+					if (use_index)
+					{
+						trigram_index::update(folder, changes, use_ignore_files, thread_count);
+						auto fresh = std::make_shared<const trigram_index>(folder);
+
+						std::lock_guard<std::mutex> lock(index_mutex);
+						index = std::move(fresh);
+					}
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "Failed to refresh: " << e.what() << std::endl;
+				}
+			});
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Cannot watch the folder: " << e.what() << std::endl;
+		}
+	});
+
+	std::unique_ptr<thread_pool> pool;
+	std::unique_ptr<uring_reader> reader;
+
+	if (thread_count > 1)
+	{
+		pool = std::make_unique<thread_pool>(thread_count);
+	}
+	else if (queue_depth)
+	{
+		try
+		{
+			constexpr size_t read_size = 0x10000; // 64 KiB
+			reader = std::make_unique<uring_reader>(queue_depth, read_size);
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+
+	std::cout << "Serving " << tree.snapshot()->size() << " files at " << socket_path << std::endl;
+
+	while (serving)
+	{
+		pollfd poll_listener = {};
+		poll_listener.fd = listener;
+		poll_listener.events = POLLIN;
+
+		// Wakes up now and then to see whether it was interrupted
+		if (poll(&poll_listener, 1, 500) <= 0)
+		{
+			continue;
+		}
+
+		const int client = accept_client(listener);
+
+		if (client == -1)
+		{
+			continue;
+		}
+
+		std::shared_ptr<const trigram_index> current_index;
+
+		{
+			std::lock_guard<std::mutex> lock(index_mutex);
+			current_index = index;
+		}
+
+		try
+		{
+			answer_query(client, tree, current_index, pool.get(), reader.get());
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to answer a query: " << e.what() << std::endl;
+		}
+
+		close(client);
+	}
+
+	watcher->stop();
+	refresher.join();
+
+	close(listener);
+	unlink(socket_path.c_str());
+}
+
+// Sends the query to the daemon at the socket and writes its response
+int query_daemon(const std::filesystem::path& socket_path, const daemon_query& query)
+{
+	const int socket = connect_to(socket_path);
+
+	try
+	{
+		send_query(socket, query);
+		const uint8_t status = receive_response(socket);
+		close(socket);
+		return status;
+	}
+	catch (...)
+	{
+		close(socket);
+		throw;
+	}
+}
+#endif
+
+// The whole value has to be a number
+template <typename T>
+bool parse_number(std::string_view value, T& number)
+{
+	const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+	return error == std::errc() && end == value.data() + value.size();
+}
+
+void print_usage(const std::filesystem::path& executable)
+{
+	std::cout << "Usage: " << executable << " [options] <folder> <mode> <expression>" << std::endl;
+	std::cout << "       " << executable << " [--threads N] [--no-ignore] [--watch] index <folder>" << std::endl;
+	std::cout << "       " << executable << " [--threads N] [--queue-depth N] [--index] [filters] serve <folder> <socket>" << std::endl;
+	std::cout << "       " << executable << " [options] query <socket> plain|regex <expression>" << std::endl;
+	std::cout << "Modes:" << std::endl;
+	std::cout << "  plain <text>           lines containing the text, ignoring the case of ASCII letters with -i" << std::endl;
+	std::cout << "  regex <expression>     lines matching the POSIX basic expression, ignoring case" << std::endl;
+	std::cout << "  multi <pattern file>   lines containing any of the patterns, one per line in the file" << std::endl;
+	std::cout << "  fuzzy <k> <text>       lines containing the text within k insertions, deletions or substitutions," << std::endl;
+	std::cout << "                         the text at most 64 bytes, ignoring the case with -i" << std::endl;
+	std::cout << "Files compressed with gzip or zstd are searched decompressed, if the format is built in." << std::endl;
+	std::cout << "Files with a UTF-16LE byte order mark are searched in plain mode, without context lines." << std::endl;
+	std::cout << "Serving keeps the files of the folder listed, and its index with --index, up to date in memory" << std::endl;
+	std::cout << "and answers the queries sent to the Unix socket, Linux only." << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  --threads N            number of worker threads, the hardware concurrency by default" << std::endl;
+	std::cout << "  --index                search only the files the index of the folder lists as candidates," << std::endl;
+	std::cout << "                         built beforehand by the index command, and those created or changed" << std::endl;
+	std::cout << "                         since, plain and regex modes only" << std::endl;
+	std::cout << "  -i, --ignore-case      ignore the case in plain and fuzzy modes, regex mode always does" << std::endl;
+	std::cout << "  --binary               search binary files too, which are skipped by default" << std::endl;
+	std::cout << "  --no-ignore            search, or index, the files .gitignore and .ignore files exclude too" << std::endl;
+	std::cout << "  --max-size N[K|M|G]    search only files of at most N bytes, KiB, MiB or GiB" << std::endl;
+	std::cout << "  --newer-than AGE       search only files modified within the age, a number with s, m, h or d" << std::endl;
+	std::cout << "  --ext EXT[,EXT...]     search only files with one of the extensions, repeatable" << std::endl;
+	std::cout << "  --type f|l             search only files that are not links, or only links to files" << std::endl;
+	std::cout << "  --max-depth N          go down at most N directories below the folder, 0 for its own files only" << std::endl;
+	std::cout << "  --split-threshold MiB  files larger than this are searched in parallel chunks, 64 by default" << std::endl;
+	std::cout << "  --files-with-matches   report only the files with a match, each file's search stops at its first" << std::endl;
+	std::cout << "  --count                report only the number of matching lines of each file with any" << std::endl;
+	std::cout << "  -A N, -B N, -C N       also write N lines after, before or around each matching line" << std::endl;
+	std::cout << "  --unordered            write each file's results as soon as it is done, not in walk order" << std::endl;
+	std::cout << "  --cache DIR            keep each file's results in the directory, a repeat of the query" << std::endl;
+	std::cout << "                         takes them from there for the files that did not change" << std::endl;
+	std::cout << "  --stats                report the files, bytes and time per phase and thread to stderr" << std::endl;
+	std::cout << "  --watch                keep the index up to date with the changes to the folder, Linux only" << std::endl;
+	std::cout << "  --queue-depth N        files read ahead through io_uring by a single thread, 64 by default," << std::endl;
+	std::cout << "                         0 maps each file in turn, Linux only" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	size_t thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+	size_t split_threshold = 0x4000000; // 64 MiB
+	unsigned queue_depth = 64;
+	uint32_t before_context = 0;
+	uint32_t after_context = 0;
+	bool use_index = false;
+	bool search_binary = false;
+	bool ignore_case = false;
+	bool use_ignore_files = true;
+	bool ordered = true;
+	output_writer::report report = output_writer::report::lines;
+	bool watch = false;
+	bool show_stats = false;
+	std::optional<std::filesystem::path> cache_directory;
+	file_filter metadata_filter;
+	std::vector<std::string> arguments;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string_view argument(argv[i]);
+
+		if (argument == "--threads" && i + 1 < argc)
+		{
+			if (!parse_number(argv[++i], thread_count) || thread_count == 0)
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if (argument == "--split-threshold" && i + 1 < argc)
+		{
+			if (!parse_number(argv[++i], split_threshold))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			split_threshold <<= 20;
+			continue;
+		}
+
+		if (argument == "--queue-depth" && i + 1 < argc)
+		{
+			if (!parse_number(argv[++i], queue_depth))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if ((argument == "-A" || argument == "-B" || argument == "-C") && i + 1 < argc)
+		{
+			uint32_t lines = 0;
+
+			if (!parse_number(argv[++i], lines))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			if (argument != "-A")
+			{
+				before_context = lines;
+			}
+
+			if (argument != "-B")
+			{
+				after_context = lines;
+			}
+
+			continue;
+		}
+
+		if (argument == "--max-size" && i + 1 < argc)
+		{
+			if (!metadata_filter.set_max_size(argv[++i]))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if (argument == "--newer-than" && i + 1 < argc)
+		{
+			if (!metadata_filter.set_newer_than(argv[++i]))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if (argument == "--ext" && i + 1 < argc)
+		{
+			if (!metadata_filter.add_extensions(argv[++i]))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if (argument == "--type" && i + 1 < argc)
+		{
+			if (!metadata_filter.set_type(argv[++i]))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if (argument == "--max-depth" && i + 1 < argc)
+		{
+			if (!metadata_filter.set_max_depth(argv[++i]))
+			{
+				print_usage(argv[0]);
+				return EINVAL;
+			}
+
+			continue;
+		}
+
+		if (argument == "--index")
+		{
+			use_index = true;
+			continue;
+		}
+
+		if (argument == "-i" || argument == "--ignore-case")
+		{
+			ignore_case = true;
+			continue;
+		}
+
+		if (argument == "--binary")
+		{
+			search_binary = true;
+			continue;
+		}
+
+		if (argument == "--no-ignore")
+		{
+			use_ignore_files = false;
+			continue;
+		}
+
+		if (argument == "--files-with-matches")
+		{
+			report = output_writer::report::files_with_matches;
+			continue;
+		}
+
+		if (argument == "--count")
+		{
+			report = output_writer::report::count;
+			continue;
+		}
+
+		if (argument == "--unordered")
+		{
+			ordered = false;
+			continue;
+		}
+
+		if (argument == "--cache" && i + 1 < argc)
+		{
+			cache_directory = argv[++i];
+			continue;
+		}
+
+		if (argument == "--stats")
+		{
+			show_stats = true;
+			continue;
+		}
+
+		if (argument == "--watch")
+		{
+			watch = true;
+			continue;
+		}
+
+		arguments.emplace_back(argument);
+	}
+
+	if (arguments.size() == 2 && arguments[0] == "index")
+	{
+		try
+		{
+			if (watch)
+			{
+#if defined(__linux__)
+				watch_index(arguments[1], use_ignore_files, thread_count);
+#else
+				std::cerr << "Watching is not supported on this platform" << std::endl;
+				return ENOTSUP;
+#endif
+			}
+			else
+			{
+				trigram_index::build(arguments[1], use_ignore_files, thread_count);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to index: " << e.what() << std::endl;
+			return EIO;
+		}
+
+		return 0;
+	}
+
+	if (arguments.size() == 3 && arguments[0] == "serve")
+	{
+#if defined(__linux__)
+		try
+		{
+			serve(arguments[1], arguments[2], use_ignore_files, use_index, metadata_filter, thread_count, queue_depth);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to serve: " << e.what() << std::endl;
+			return EIO;
+		}
+
+		return 0;
+#else
+		std::cerr << "Serving is not supported on this platform" << std::endl;
+		return ENOTSUP;
+#endif
+	}
+
+	if (arguments.size() == 4 && arguments[0] == "query")
+	{
+#if defined(__linux__)
+		daemon_query query;
+
+		if (arguments[2] == "plain")
+		{
+			query.mode = daemon_query::search_mode::plain;
+		}
+		else if (arguments[2] == "regex")
+		{
+			query.mode = daemon_query::search_mode::regex;
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return EINVAL;
+		}
+
+		query.ignore_case = ignore_case;
+		query.search_binary = search_binary;
+		query.report = report;
+		query.before_context = before_context;
+		query.after_context = after_context;
+		query.expression = arguments[3];
+
+		try
+		{
+			return query_daemon(arguments[1], query);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Cannot query the daemon: " << e.what() << std::endl;
+			return EIO;
+		}
+#else
+		std::cerr << "Querying a daemon is not supported on this platform" << std::endl;
+		return ENOTSUP;
+#endif
+	}
+
+	if (arguments.size() < 3)
+	{
+		print_usage(argv[0]);
+		return EINVAL;
+	}
+
+	const std::filesystem::path path(arguments[0]);
+	const std::string& mode = arguments[1];
+	search_settings settings;
+	std::optional<std::string> index_literal;
+
+	// Everything that shapes the results of a file, the cache is kept by it
+	std::string query;
+
+	const auto describe = [&](std::string_view part)
+	{
+		query += part;
+		query += '\0';
+	};
+
+	describe(mode);
+
+	if (mode == "plain")
+	{
+		set_up_plain(settings, arguments[2], ignore_case);
+		index_literal = arguments[2];
+	}
+	else if(mode == "regex")
+	{
+		try
+		{
+			index_literal = set_up_regex(settings, arguments[2]);
+		}
+		catch (const std::regex_error& e)
+		{
+			std::cerr << "Invalid expression: " << e.what() << std::endl;
+			return EINVAL;
+		}
+	}
+	else if (mode == "multi")
+	{
+		try
+		{
+			const std::vector<std::string> patterns = read_patterns(arguments[2]);
+			const aho_corasick automaton(patterns);
+
+			for (const std::string& pattern : patterns)
+			{
+				describe(pattern);
+			}
+
+			settings.search_function = std::bind(lines_containing_any, std::placeholders::_1, automaton, std::placeholders::_2);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Cannot read patterns: " << e.what() << std::endl;
+			return EINVAL;
+		}
+	}
+	else if (mode == "fuzzy" && arguments.size() > 3)
+	{
+		uint32_t max_distance = 0;
+
+		if (!parse_number(arguments[2], max_distance))
+		{
+			print_usage(argv[0]);
+			return EINVAL;
+		}
+
+		try
+		{
+			const fuzzy_searcher searcher(arguments[3], max_distance, ignore_case);
+			std::vector<plain_searcher> pieces;
+
+			for (const std::string& piece : searcher.exact_pieces())
+			{
+				pieces.emplace_back(piece, ignore_case);
+			}
+
+			settings.search_function = std::bind(lines_resembling, std::placeholders::_1, searcher, pieces, std::placeholders::_2);
+		}
+		catch (const std::invalid_argument& e)
+		{
+			std::cerr << "Invalid text: " << e.what() << std::endl;
+			return EINVAL;
+		}
+	}
+	else
+	{
+		print_usage(argv[0]);
+		return EINVAL;
+	}
+
+	if (mode != "multi")
+	{
+		for (size_t i = 2; i < arguments.size(); ++i)
+		{
+			describe(arguments[i]);
+		}
+	}
+
+	describe(ignore_case ? "ignore case" : "");
+	describe(search_binary ? "binary" : "");
+	describe(std::to_string(before_context) + ' ' + std::to_string(after_context));
+	describe(std::to_string(static_cast<int>(report)));
+
+	settings.search_binary = search_binary;
+	settings.metadata_filter = std::move(metadata_filter);
+	settings.before_context = before_context;
+	settings.after_context = after_context;
+	settings.split_threshold = split_threshold;
+
+	// The walk, the files and the chunks of huge files share the threads.
+	// Huge files are split only when there are threads to share them.
+	std::unique_ptr<thread_pool> pool;
+
+	if (thread_count > 1)
+	{
+		pool = std::make_unique<thread_pool>(thread_count);
+		settings.chunk_pool = pool.get();
+	}
+
+	std::unique_ptr<search_stats> stats;
+
+	if (show_stats)
+	{
+		stats = std::make_unique<search_stats>();
+		settings.stats = stats.get();
+	}
+
+	std::unique_ptr<result_cache> cache;
+
+	if (cache_directory)
+	{
+		cache = std::make_unique<result_cache>(*cache_directory, query);
+		settings.cache = cache.get();
+	}
+
+	output_writer output(ordered, report, stats.get());
+
+	file_visitor visit = [&](const std::filesystem::path& file_path, std::optional<uint64_t>)
+	{
+		search_file(file_path, settings, output);
+		return !output.failed();
+	};
+
+#if defined(__linux__)
+	// A single thread reads ahead, the kernel may not let it
+	std::unique_ptr<uring_reader> reader;
+	std::unique_ptr<read_ahead> ahead;
+
+	if (thread_count == 1 && queue_depth)
+	{
+		try
+		{
+			constexpr size_t read_size = 0x10000; // 64 KiB
+
+			reader = std::make_unique<uring_reader>(queue_depth, read_size);
+			ahead = std::make_unique<read_ahead>(*reader, settings, output);
+
+			visit = [&](const std::filesystem::path& file_path, std::optional<uint64_t> size)
+			{
+				return ahead->visit(file_path, size);
+			};
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+#endif
+
+	const auto ignores = use_ignore_files ? ignore_filter::load(nullptr, path) : nullptr;
+
+	if (use_index && index_literal)
+	{
+		try
+		{
+			indexed_search(pool.get(), path, ignores, *index_literal, settings, output, visit);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Cannot read index: " << e.what() << std::endl;
+			return EIO;
+		}
+	}
+	else if (pool)
+	{
+		parallel_search(*pool, path, ignores, settings, output);
+	}
+	else
+	{
+		search(path, ignores, settings.metadata_filter, visit, settings.stats);
+	}
+
+#if defined(__linux__)
+	if (ahead)
+	{
+		ahead->finish();
+	}
+#endif
+
+	try
+	{
+		output.flush();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Cannot write results: " << e.what() << std::endl;
+		return EIO;
+	}
+
+	if (cache)
+	{
+		try
+		{
+			cache->save();
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Cannot write the cache: " << e.what() << std::endl;
+			return EIO;
+		}
+	}
+
+	if (stats)
+	{
+		stats->report(std::cerr);
 	}
 
 	return 0;
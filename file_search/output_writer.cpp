@@ -0,0 +1,667 @@
+#include "output_writer.hpp"
+#include "search_stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr size_t buffer_size = 0x10000; // 64 KiB
+	constexpr size_t max_buffers = 0x400;   // IOV_MAX on Linux
+	constexpr size_t block_size = 0x10000;  // Handed over by a sink at a time
+	constexpr size_t max_held_size = 0x4000000; // 64 MiB held back in memory
+
+	bool seek(std::FILE* file, uint64_t offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+
+	void write_buffers([[maybe_unused]] int descriptor, const std::vector<std::string>& buffers)
+	{
+#ifdef _WIN32
+		for (const std::string& buffer : buffers)
+		{
+			std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+		}
+
+		std::fflush(stdout);
+#else
+		std::vector<iovec> vectors;
+		vectors.reserve(buffers.size());
+
+		for (const std::string& buffer : buffers)
+		{
+			vectors.push_back({ const_cast<char*>(buffer.data()), buffer.size() });
+		}
+
+		for (size_t first = 0; first < vectors.size();)
+		{
+			const int count = static_cast<int>(std::min(vectors.size() - first, max_buffers));
+			ssize_t written = writev(descriptor, &vectors[first], count);
+
+			if (written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				throw std::system_error(errno, std::system_category(), "writev failed");
+			}
+
+			// Skip what got written, a partial write resumes mid buffer
+			while (first < vectors.size() && static_cast<size_t>(written) >= vectors[first].iov_len)
+			{
+				written -= static_cast<ssize_t>(vectors[first].iov_len);
+				++first;
+			}
+
+			if (written)
+			{
+				vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + written;
+				vectors[first].iov_len -= static_cast<size_t>(written);
+			}
+		}
+#endif
+	}
+}
+
+class output_writer::directory
+{
+public:
+	struct entry
+	{
+		bool done = false;
+		std::string results;
+		std::unique_ptr<directory> listing;
+
+		// The offsets and sizes of the results spilled, which follow those
+		// in memory. Once an entry spilled, all the rest of its results do.
+		std::vector<std::pair<uint64_t, size_t>> spilled;
+	};
+
+	directory* parent = nullptr;
+	size_t index = 0;
+	std::vector<entry> entries;
+
+	// The first entry not written yet
+	size_t next = 0;
+};
+
+output_writer::output_writer(bool ordered, report what, search_stats* stats, int descriptor) :
+	_ordered(ordered),
+	_report(what),
+	_stats(stats),
+	_descriptor(descriptor),
+	_root(std::make_unique<directory>())
+{
+	_root->entries.resize(1);
+	_cursor = _root.get();
+}
+
+output_writer::~output_writer()
+{
+	try
+	{
+		flush();
+	}
+	catch (const std::exception&)
+	{
+	}
+}
+
+output_writer::report output_writer::what() const
+{
+	return _report;
+}
+
+output_writer::slot output_writer::root()
+{
+	return { _root.get(), 0 };
+}
+
+output_writer::directory* output_writer::list(const slot& slot, size_t entry_count)
+{
+	if (!_ordered || !slot.parent)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto listing = std::make_unique<directory>();
+	listing->parent = slot.parent;
+	listing->index = slot.index;
+	listing->entries.resize(entry_count);
+
+	directory* result = listing.get();
+	slot.parent->entries[slot.index].listing = std::move(listing);
+
+	advance();
+	return result;
+}
+
+void output_writer::append(const slot& slot, std::string&& results)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_ordered)
+	{
+		_pending.emplace_back(std::move(results));
+		write_pending();
+		return;
+	}
+
+	if (!slot.parent)
+	{
+		write(std::move(results));
+		return;
+	}
+
+	// The first slot not done gets written straight through
+	if (_cursor == slot.parent && _cursor->next == slot.index)
+	{
+		write(std::move(results));
+		return;
+	}
+
+	hold(slot.parent, slot.index, std::move(results));
+}
+
+void output_writer::complete(const slot& slot, std::string&& results)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_ordered)
+	{
+		if (!results.empty())
+		{
+			_pending.emplace_back(std::move(results));
+			write_pending();
+		}
+
+		return;
+	}
+
+	if (!slot.parent)
+	{
+		write(std::move(results));
+		return;
+	}
+
+	hold(slot.parent, slot.index, std::move(results));
+	slot.parent->entries[slot.index].done = true;
+
+	advance();
+}
+
+void output_writer::flush()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	write_pending();
+
+	if (_failure)
+	{
+		std::rethrow_exception(_failure);
+	}
+}
+
+bool output_writer::failed() const
+{
+	return _failed.load(std::memory_order_relaxed);
+}
+
+void output_writer::advance()
+{
+	directory* current = _cursor;
+
+	while (current)
+	{
+		// A directory written out in full hands over to the next entry of its
+		// parent, the listing is not needed anymore
+		if (current->next == current->entries.size())
+		{
+			directory* parent = current->parent;
+
+			if (!parent)
+			{
+				break;
+			}
+
+			parent->entries[current->index].listing.reset();
+			++parent->next;
+			current = parent;
+			continue;
+		}
+
+		directory::entry& entry = current->entries[current->next];
+
+		if (entry.listing)
+		{
+			current = entry.listing.get();
+			continue;
+		}
+
+		release(current, current->next);
+
+		if (!entry.done)
+		{
+			break;
+		}
+
+		++current->next;
+	}
+
+	_cursor = current;
+}
+
+void output_writer::hold(directory* parent, size_t index, std::string&& results)
+{
+	directory::entry& entry = parent->entries[index];
+
+	if (results.empty())
+	{
+		return;
+	}
+
+	if (entry.spilled.empty() && _held_size + results.size() <= max_held_size)
+	{
+		_held_size += results.size();
+		entry.results += results;
+		return;
+	}
+
+	if (const std::optional<uint64_t> offset = spill(results))
+	{
+		// Spilled right after the entry's previous results, they join them
+		if (!entry.spilled.empty() && entry.spilled.back().first + entry.spilled.back().second == *offset)
+		{
+			entry.spilled.back().second += results.size();
+		}
+		else
+		{
+			entry.spilled.emplace_back(*offset, results.size());
+		}
+
+		return;
+	}
+
+	// Without a spill file the results stay in memory, once none of the
+	// entry's went there they keep their order
+	if (entry.spilled.empty())
+	{
+		_held_size += results.size();
+		entry.results += results;
+		return;
+	}
+
+	_failure = std::make_exception_ptr(std::runtime_error("cannot spill the results held back"));
+	_failed = true;
+}
+
+void output_writer::release(directory* parent, size_t index)
+{
+	directory::entry& entry = parent->entries[index];
+
+	_held_size -= entry.results.size();
+	write(std::move(entry.results));
+	entry.results.clear();
+
+	for (const auto& [offset, size] : entry.spilled)
+	{
+		if (_failed)
+		{
+			break;
+		}
+
+		if (!seek(_spill_file.get(), offset))
+		{
+			_failure = std::make_exception_ptr(std::runtime_error("cannot read back the results spilled"));
+			_failed = true;
+			break;
+		}
+
+		// Read back a buffer at a time
+		for (size_t done = 0; done < size;)
+		{
+			std::string results(std::min(size - done, buffer_size), '\0');
+
+			if (std::fread(results.data(), 1, results.size(), _spill_file.get()) != results.size())
+			{
+				_failure = std::make_exception_ptr(std::runtime_error("cannot read back the results spilled"));
+				_failed = true;
+				break;
+			}
+
+			done += results.size();
+			write(std::move(results));
+		}
+	}
+
+	entry.spilled.clear();
+}
+
+std::optional<uint64_t> output_writer::spill(const std::string& results)
+{
+	if (!_spill_file)
+	{
+		_spill_file.reset(std::tmpfile());
+
+		if (!_spill_file)
+		{
+			return {};
+		}
+	}
+
+	const uint64_t offset = _spill_size;
+
+	if (!seek(_spill_file.get(), offset) ||
+		std::fwrite(results.data(), 1, results.size(), _spill_file.get()) != results.size())
+	{
+		return {};
+	}
+
+	_spill_size += results.size();
+	return offset;
+}
+
+void output_writer::write(std::string&& results)
+{
+	if (results.empty())
+	{
+		return;
+	}
+
+	_pending_size += results.size();
+	_pending.emplace_back(std::move(results));
+
+	if (_pending_size >= buffer_size || _pending.size() >= max_buffers)
+	{
+		write_pending();
+	}
+}
+
+void output_writer::write_pending()
+{
+	phase_timer timer(_stats, search_stats::output);
+
+	// The failure is not the file's being searched, it waits for the flush
+	try
+	{
+		if (!_failed)
+		{
+			write_buffers(_descriptor, _pending);
+		}
+	}
+	catch (const std::exception&)
+	{
+		_failure = std::current_exception();
+		_failed = true;
+	}
+
+	_pending.clear();
+	_pending_size = 0;
+}
+
+match_sink::match_sink(output_writer& output, const output_writer::slot& slot, const std::filesystem::path& path) :
+	_output(output),
+	_slot(slot),
+	_path(path),
+	_report(output.what())
+{
+}
+
+bool match_sink::line(uint64_t number, std::string_view text)
+{
+	++_count;
+
+	if (_report != output_writer::report::lines)
+	{
+		return _report == output_writer::report::count;
+	}
+
+	begin_line(number, ':');
+	_buffer += text;
+	end_line();
+	return !_output.failed();
+}
+
+bool match_sink::line(uint64_t number, std::string_view label, std::string_view text)
+{
+	++_count;
+
+	if (_report != output_writer::report::lines)
+	{
+		return _report == output_writer::report::count;
+	}
+
+	begin_line(number, ':');
+	_buffer += label;
+	_buffer += ':';
+	_buffer += text;
+	end_line();
+	return !_output.failed();
+}
+
+void match_sink::context(uint64_t number, std::string_view text)
+{
+	if (_report != output_writer::report::lines)
+	{
+		return;
+	}
+
+	begin_line(number, '-');
+	_buffer += text;
+	end_line();
+}
+
+void match_sink::separator()
+{
+	if (_report != output_writer::report::lines)
+	{
+		return;
+	}
+
+	_buffer += "--";
+	end_line();
+}
+
+output_writer::report match_sink::what() const
+{
+	return _report;
+}
+
+void match_sink::keep_copy(size_t max_size)
+{
+	_copying = true;
+	_max_copy_size = max_size;
+}
+
+const std::string* match_sink::copy() const
+{
+	return _copying ? &_copy : nullptr;
+}
+
+void match_sink::close()
+{
+	if (_count && _report != output_writer::report::lines)
+	{
+		_buffer += quoted_path();
+
+		if (_report == output_writer::report::count)
+		{
+			_buffer += ':';
+			_buffer += std::to_string(_count);
+		}
+
+		_buffer += '\n';
+	}
+
+	hand_over(true);
+}
+
+void match_sink::begin_line(uint64_t number, char delimiter)
+{
+	if (_prefix.empty())
+	{
+		_prefix = quoted_path();
+	}
+
+	char digits[24];
+	const auto [end, error] = std::to_chars(std::begin(digits), std::end(digits), number);
+
+	_buffer += _prefix;
+	_buffer += delimiter;
+	_buffer.append(digits, end);
+	_buffer += delimiter;
+}
+
+void match_sink::end_line()
+{
+	_buffer += '\n';
+
+	if (_buffer.size() >= block_size)
+	{
+		hand_over(false);
+	}
+}
+
+void match_sink::hand_over(bool done)
+{
+	if (_copying)
+	{
+		_copying = _copy.size() + _buffer.size() <= _max_copy_size;
+
+		if (_copying)
+		{
+			_copy += _buffer;
+		}
+		else
+		{
+			_copy = {};
+		}
+	}
+
+	if (done)
+	{
+		_output.complete(_slot, std::move(_buffer));
+	}
+	else
+	{
+		_output.append(_slot, std::move(_buffer));
+	}
+
+	_buffer.clear();
+}
+
+// The path quoted as the stream output of a path does
+std::string match_sink::quoted_path() const
+{
+	std::ostringstream quoted;
+	quoted << _path;
+	return quoted.str();
+}
+
+context_sink::context_sink(match_sink& sink, std::string_view contents, uint32_t before, uint32_t after) :
+	_sink(sink),
+	_contents(contents),
+	_before(before),
+	_after(after)
+{
+}
+
+bool context_sink::line(uint64_t number, std::string_view text)
+{
+	begin_match(number, text);
+	const bool more = _sink.line(number, text);
+	end_match(number, text);
+	return more;
+}
+
+bool context_sink::line(uint64_t number, std::string_view label, std::string_view text)
+{
+	begin_match(number, text);
+	const bool more = _sink.line(number, label, text);
+	end_match(number, text);
+	return more;
+}
+
+void context_sink::finish()
+{
+	write_after(UINT64_MAX);
+}
+
+void context_sink::move_on(std::string_view contents, uint64_t first_number)
+{
+	_contents = contents;
+	_next_offset = 0;
+
+	// The first line not written may be among the ones repeated
+	for (uint64_t number = first_number; number < _next_number && _next_offset < _contents.size(); ++number)
+	{
+		_next_offset = std::min(_contents.find('\n', _next_offset), _contents.size()) + 1;
+	}
+}
+
+void context_sink::begin_match(uint64_t number, std::string_view text)
+{
+	write_after(number);
+
+	// Back over the lines before the match, not into those written already
+	const size_t floor = _written ? _next_offset : 0;
+	size_t begin = static_cast<size_t>(text.data() - _contents.data());
+	uint32_t count = 0;
+
+	while (count < _before && begin > floor)
+	{
+		begin = begin > 1 ? _contents.rfind('\n', begin - 2) + 1 : 0;
+		++count;
+	}
+
+	if (_written && number - count > _next_number)
+	{
+		_sink.separator();
+	}
+
+	for (uint32_t i = count; i > 0; --i)
+	{
+		const size_t end = _contents.find('\n', begin);
+		_sink.context(number - i, _contents.substr(begin, end - begin));
+		begin = end + 1;
+	}
+}
+
+void context_sink::end_match(uint64_t number, std::string_view text)
+{
+	_written = true;
+	_next_number = number + 1;
+	_next_offset = static_cast<size_t>(text.data() - _contents.data()) + text.size() + 1;
+	_after_left = _after;
+}
+
+void context_sink::write_after(uint64_t end_number)
+{
+	while (_after_left && _next_number < end_number && _next_offset < _contents.size())
+	{
+		const size_t end = std::min(_contents.find('\n', _next_offset), _contents.size());
+		_sink.context(_next_number, _contents.substr(_next_offset, end - _next_offset));
+
+		--_after_left;
+		++_next_number;
+		_next_offset = end + 1;
+	}
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class search_stats;
+
+// Collects the results of the searched files and writes them to the standard
+// output, many files' worth in one vectored write. In order, the results come
+// out in the order of the walk whichever order the files finish in; out of
+// order, each file's results are written the moment the file is done.
+//
+// The order of a parallel walk is kept in a tree of the directory listings:
+// each directory reserves a slot per entry, in order, and the results are
+// written as soon as every slot before theirs is done. The results held back
+// meanwhile are kept in memory up to a budget, beyond it they are spilled to a
+// temporary file and read back in turn, so however far the walk runs ahead of
+// a slow file the memory stays flat.
+class output_writer
+{
+public:
+	class directory;
+
+	// What is reported of a file
+	enum class report
+	{
+		lines,
+		files_with_matches,
+		count
+	};
+
+	// A place in the walk: an entry of a directory listing. The default slot
+	// stands for the next place of a sequential walk.
+	struct slot
+	{
+		directory* parent = nullptr;
+		size_t index = 0;
+	};
+
+	// The time spent writing is counted into the stats, if any. Outside of
+	// Windows the results may go to another descriptor than the standard
+	// output, such as the socket of a client. Once a write fails, the failure
+	// is kept for the flush to throw and the rest of the results are dropped
+	// rather than kept waiting on a reader gone.
+	output_writer(bool ordered, report what, search_stats* stats = nullptr, int descriptor = 1);
+	~output_writer();
+
+	report what() const;
+
+	// The slot of the searched folder itself
+	slot root();
+
+	// Reserves a slot for each entry of the directory in the slot, which the
+	// entries are numbered within. Returns null when out of order.
+	directory* list(const slot& slot, size_t entry_count);
+
+	// Part of the results of the file in the slot, more are to come. They are
+	// written right away unless results before the slot are still pending.
+	void append(const slot& slot, std::string&& results);
+
+	// The rest of the results of the file in the slot, or of a directory that
+	// will not be listed, which are none
+	void complete(const slot& slot, std::string&& results);
+
+	// Writes whatever is buffered, throws the failure of any write so far
+	void flush();
+
+	// Whether a write failed, there is no point in searching any further
+	bool failed() const;
+
+private:
+	output_writer(const output_writer&) = delete;
+	output_writer(output_writer&&) = delete;
+	output_writer& operator = (const output_writer&) = delete;
+	output_writer& operator = (output_writer&&) = delete;
+
+	// Writes out the results of the slots done in order from the cursor on,
+	// and whatever the first slot not done has so far
+	void advance();
+
+	void write(std::string&& results);
+	void write_pending();
+
+	// Keeps the results of an entry until its turn, and writes them then
+	void hold(directory* parent, size_t index, std::string&& results);
+	void release(directory* parent, size_t index);
+
+	// Appends to the spill file and returns where the results start, none if
+	// they could not be spilled
+	std::optional<uint64_t> spill(const std::string& results);
+
+	const bool _ordered;
+	const report _report;
+	search_stats* const _stats;
+	const int _descriptor;
+	std::mutex _mutex;
+
+	std::unique_ptr<directory> _root;
+	directory* _cursor = nullptr;
+
+	// The results held in memory, and the file the rest are spilled to
+	size_t _held_size = 0;
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> _spill_file = { nullptr, std::fclose };
+	uint64_t _spill_size = 0;
+
+	std::vector<std::string> _pending;
+	size_t _pending_size = 0;
+	std::atomic<bool> _failed = false;
+	std::exception_ptr _failure;
+};
+
+// Receives the matching lines of a file, or of a part of it, as they are found
+class line_sink
+{
+public:
+	virtual ~line_sink() = default;
+
+	// Both return whether the search should go on
+	virtual bool line(uint64_t number, std::string_view text) = 0;
+
+	// A line labelled with what it matched
+	virtual bool line(uint64_t number, std::string_view label, std::string_view text) = 0;
+};
+
+// Formats the matching lines of one file for the output and hands them over a
+// block at a time, so the memory it takes stays flat however many lines match.
+// When only the file or the count is reported, no line is formatted at all and
+// the search need not go on once the file is known to match.
+class match_sink : public line_sink
+{
+public:
+	match_sink(output_writer& output, const output_writer::slot& slot, const std::filesystem::path& path);
+
+	bool line(uint64_t number, std::string_view text) override;
+	bool line(uint64_t number, std::string_view label, std::string_view text) override;
+
+	// A line around a match, marked off by dashes instead of colons
+	void context(uint64_t number, std::string_view text);
+
+	// Parts the groups of lines that are not adjacent
+	void separator();
+
+	output_writer::report what() const;
+
+	// Keeps a copy of all it hands over, as long as that stays within the size
+	void keep_copy(size_t max_size);
+
+	// The copy of the results, null if none was kept or they outgrew it
+	const std::string* copy() const;
+
+	// Hands over the rest, the file is done
+	void close();
+
+private:
+	void begin_line(uint64_t number, char delimiter);
+	void end_line();
+	void hand_over(bool done);
+	std::string quoted_path() const;
+
+	output_writer& _output;
+	const output_writer::slot _slot;
+	const std::filesystem::path& _path;
+	const output_writer::report _report;
+	size_t _count = 0;
+
+	// The quoted path, formatted on the first line only
+	std::string _prefix;
+	std::string _buffer;
+
+	bool _copying = false;
+	size_t _max_copy_size = 0;
+	std::string _copy;
+};
+
+// Adds the lines before and after each match, which it takes straight from the
+// contents the matching lines point into, so the file is never read again.
+// The matches must come in order; lines in reach of two matches are written
+// once and groups that do not touch are parted by a separator.
+class context_sink : public line_sink
+{
+public:
+	context_sink(match_sink& sink, std::string_view contents, uint32_t before, uint32_t after);
+
+	bool line(uint64_t number, std::string_view text) override;
+	bool line(uint64_t number, std::string_view label, std::string_view text) override;
+
+	// Writes the lines after the last match, as far as the contents reach
+	void finish();
+
+	// Goes on with the contents that follow, which start with the line of the
+	// number and may repeat the last lines of the ones before for the context.
+	// The ones before must have been finished.
+	void move_on(std::string_view contents, uint64_t first_number);
+
+private:
+	// Writes the lines before the match and those still due after the previous
+	void begin_match(uint64_t number, std::string_view text);
+	void end_match(uint64_t number, std::string_view text);
+
+	// Writes the lines after the last match up to, not including, the line
+	void write_after(uint64_t end_number);
+
+	match_sink& _sink;
+	std::string_view _contents;
+	const uint32_t _before;
+	const uint32_t _after;
+
+	// The first line not written yet, once any is
+	bool _written = false;
+	uint64_t _next_number = 1;
+	size_t _next_offset = 0;
+	uint32_t _after_left = 0;
+};
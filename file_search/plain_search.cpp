@@ -0,0 +1,341 @@
+#include "plain_search.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PLAIN_SEARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	using find_function = size_t(*)(std::string_view haystack, std::string_view needle);
+
+	size_t find_scalar(std::string_view haystack, std::string_view needle)
+	{
+		return haystack.find(needle);
+	}
+
+	unsigned char fold_case(unsigned char c)
+	{
+		return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+	}
+
+#ifdef PLAIN_SEARCH_X86
+	// The bytes equal the case folded needle, ignoring the case of ASCII letters
+	bool equal_folded(const char* data, std::string_view folded)
+	{
+		for (size_t i = 0; i < folded.size(); ++i)
+		{
+			if (fold_case(static_cast<unsigned char>(data[i])) != static_cast<unsigned char>(folded[i]))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Setting the case bit of a letter makes either case equal the folded one,
+	// other bytes are compared as they are
+	char case_bit(char folded)
+	{
+		return folded >= 'a' && folded <= 'z' ? 0x20 : 0;
+	}
+
+	size_t find_folded_from(std::string_view haystack, std::string_view folded, size_t i)
+	{
+		for (; i + folded.size() <= haystack.size(); ++i)
+		{
+			if (equal_folded(haystack.data() + i, folded))
+			{
+				return i;
+			}
+		}
+
+		return std::string_view::npos;
+	}
+
+	// All kernels expect a needle of at least two bytes
+
+	size_t find_sse2(std::string_view haystack, std::string_view needle)
+	{
+		const char* data = haystack.data();
+		const size_t last_offset = needle.size() - 1;
+		const __m128i first = _mm_set1_epi8(needle.front());
+		const __m128i last = _mm_set1_epi8(needle.back());
+		size_t i = 0;
+
+		for (; i + last_offset + sizeof(__m128i) <= haystack.size(); i += sizeof(__m128i))
+		{
+			const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + last_offset));
+			const __m128i equal = _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last));
+
+			for (uint32_t mask = _mm_movemask_epi8(equal); mask; mask &= mask - 1)
+			{
+				const size_t position = i + std::countr_zero(mask);
+
+				if (!std::memcmp(data + position + 1, needle.data() + 1, last_offset - 1))
+				{
+					return position;
+				}
+			}
+		}
+
+		return haystack.find(needle, i);
+	}
+
+	// The needle is case folded, the first and last bytes of the haystack are
+	// folded in the registers as they are compared
+	size_t find_ignoring_case_sse2(std::string_view haystack, std::string_view needle)
+	{
+		const char* data = haystack.data();
+		const size_t last_offset = needle.size() - 1;
+		const __m128i first = _mm_set1_epi8(needle.front());
+		const __m128i last = _mm_set1_epi8(needle.back());
+		const __m128i first_case = _mm_set1_epi8(case_bit(needle.front()));
+		const __m128i last_case = _mm_set1_epi8(case_bit(needle.back()));
+		size_t i = 0;
+
+		for (; i + last_offset + sizeof(__m128i) <= haystack.size(); i += sizeof(__m128i))
+		{
+			const __m128i block_first = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), first_case);
+			const __m128i block_last = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + last_offset)), last_case);
+			const __m128i equal = _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last));
+
+			for (uint32_t mask = _mm_movemask_epi8(equal); mask; mask &= mask - 1)
+			{
+				const size_t position = i + std::countr_zero(mask);
+
+				if (equal_folded(data + position + 1, needle.substr(1, last_offset - 1)))
+				{
+					return position;
+				}
+			}
+		}
+
+		return find_folded_from(haystack, needle, i);
+	}
+
+	TARGET_AVX2 size_t find_avx2(std::string_view haystack, std::string_view needle)
+	{
+		const char* data = haystack.data();
+		const size_t last_offset = needle.size() - 1;
+		const __m256i first = _mm256_set1_epi8(needle.front());
+		const __m256i last = _mm256_set1_epi8(needle.back());
+		size_t i = 0;
+
+		for (; i + last_offset + sizeof(__m256i) <= haystack.size(); i += sizeof(__m256i))
+		{
+			const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + last_offset));
+			const __m256i equal = _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last));
+
+			for (uint32_t mask = _mm256_movemask_epi8(equal); mask; mask &= mask - 1)
+			{
+				const size_t position = i + std::countr_zero(mask);
+
+				if (!std::memcmp(data + position + 1, needle.data() + 1, last_offset - 1))
+				{
+					return position;
+				}
+			}
+		}
+
+		return haystack.find(needle, i);
+	}
+
+	TARGET_AVX2 size_t find_ignoring_case_avx2(std::string_view haystack, std::string_view needle)
+	{
+		const char* data = haystack.data();
+		const size_t last_offset = needle.size() - 1;
+		const __m256i first = _mm256_set1_epi8(needle.front());
+		const __m256i last = _mm256_set1_epi8(needle.back());
+		const __m256i first_case = _mm256_set1_epi8(case_bit(needle.front()));
+		const __m256i last_case = _mm256_set1_epi8(case_bit(needle.back()));
+		size_t i = 0;
+
+		for (; i + last_offset + sizeof(__m256i) <= haystack.size(); i += sizeof(__m256i))
+		{
+			const __m256i block_first = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), first_case);
+			const __m256i block_last = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + last_offset)), last_case);
+			const __m256i equal = _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last));
+
+			for (uint32_t mask = _mm256_movemask_epi8(equal); mask; mask &= mask - 1)
+			{
+				const size_t position = i + std::countr_zero(mask);
+
+				if (equal_folded(data + position + 1, needle.substr(1, last_offset - 1)))
+				{
+					return position;
+				}
+			}
+		}
+
+		return find_folded_from(haystack, needle, i);
+	}
+
+	bool cpu_has_avx2()
+	{
+#ifdef _MSC_VER
+		int info[4] = {};
+		__cpuid(info, 0);
+
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuid(info, 1);
+
+		// The OS has to save the YMM registers too
+		constexpr int osxsave = 1 << 27;
+
+		if (!(info[2] & osxsave) || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	struct kernel
+	{
+		find_function function;
+
+		// For a case folded needle, null if the scalar search does it
+		find_function function_ignoring_case;
+		std::string_view name;
+	};
+
+	kernel select_kernel()
+	{
+#ifdef PLAIN_SEARCH_X86
+		if (cpu_has_avx2())
+		{
+			return { find_avx2, find_ignoring_case_avx2, "avx2" };
+		}
+
+		return { find_sse2, find_ignoring_case_sse2, "sse2" };
+#else
+		return { find_scalar, nullptr, "scalar" };
+#endif
+	}
+
+	const kernel& selected_kernel()
+	{
+		static const kernel selected = select_kernel();
+		return selected;
+	}
+}
+
+plain_searcher::plain_searcher(std::string_view needle, bool ignore_case) :
+	_needle(needle),
+	_ignore_case(ignore_case)
+{
+	if (!_ignore_case)
+	{
+		return;
+	}
+
+	for (char& c : _needle)
+	{
+		c = static_cast<char>(fold_case(static_cast<unsigned char>(c)));
+	}
+
+	_shifts.fill(std::max(_needle.size(), size_t(1)));
+
+	for (size_t i = 0; i + 1 < _needle.size(); ++i)
+	{
+		_shifts[static_cast<unsigned char>(_needle[i])] = _needle.size() - 1 - i;
+	}
+}
+
+size_t plain_searcher::find(std::string_view haystack, size_t offset) const
+{
+	if (offset > haystack.size())
+	{
+		return std::string_view::npos;
+	}
+
+	const std::string_view remaining = haystack.substr(offset);
+	size_t position = std::string_view::npos;
+
+	if (_ignore_case)
+	{
+		const find_function function = selected_kernel().function_ignoring_case;
+		position = function && _needle.size() >= 2 ? function(remaining, _needle) : find_ignoring_case(remaining);
+	}
+	else if (_needle.size() < 2)
+	{
+		position = find_scalar(remaining, _needle);
+	}
+	else
+	{
+		position = selected_kernel().function(remaining, _needle);
+	}
+
+	return position == std::string_view::npos ? position : position + offset;
+}
+
+size_t plain_searcher::find_ignoring_case(std::string_view haystack) const
+{
+	if (_needle.empty())
+	{
+		return 0;
+	}
+
+	const size_t last = _needle.size() - 1;
+
+	for (size_t i = 0; i + last < haystack.size();)
+	{
+		const unsigned char c = fold_case(static_cast<unsigned char>(haystack[i + last]));
+
+		if (c == static_cast<unsigned char>(_needle[last]))
+		{
+			size_t j = 0;
+
+			while (j < last && fold_case(static_cast<unsigned char>(haystack[i + j])) == static_cast<unsigned char>(_needle[j]))
+			{
+				++j;
+			}
+
+			if (j == last)
+			{
+				return i;
+			}
+		}
+
+		i += _shifts[c];
+	}
+
+	return std::string_view::npos;
+}
+
+std::string_view plain_searcher::needle() const
+{
+	return _needle;
+}
+
+std::string_view plain_searcher::kernel_name()
+{
+	return selected_kernel().name;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+
+// Substring search over whole buffers. Candidate positions are found by
+// comparing the first and the last byte of the needle a vector at a time and
+// only those candidates are compared in full. The widest kernel the CPU
+// supports is picked at runtime. Ignoring the case, the kernels fold the bytes
+// they compare in the registers rather than a copy of the haystack.
+class plain_searcher
+{
+public:
+	// Ignoring the case folds ASCII letters only
+	explicit plain_searcher(std::string_view needle, bool ignore_case = false);
+
+	// Returns the position of the first occurrence at or after the offset,
+	// or std::string_view::npos if there is none
+	size_t find(std::string_view haystack, size_t offset = 0) const;
+
+	std::string_view needle() const;
+
+	// Name of the kernel in use, for diagnostics and benchmarks
+	static std::string_view kernel_name();
+
+private:
+	// Where there is no vector kernel or the needle is a single byte
+	size_t find_ignoring_case(std::string_view haystack) const;
+
+	std::string _needle;
+	bool _ignore_case;
+
+	// Horspool shifts for the case folded needle
+	std::array<size_t, 256> _shifts = {};
+};
@@ -0,0 +1,202 @@
+#include "resident_tree.hpp"
+#include "trigram_index.hpp"
+
+#include <system_error>
+
+#include <sys/stat.h>
+
+resident_tree::resident_tree(const std::filesystem::path& folder, bool use_ignore_files, const file_filter& metadata_filter) :
+	_folder(folder),
+	_use_ignore_files(use_ignore_files),
+	_metadata_filter(metadata_filter)
+{
+	list(_folder, _use_ignore_files ? ignore_filter::load(nullptr, _folder) : nullptr, 0);
+	publish();
+}
+
+void resident_tree::update(const std::vector<std::filesystem::path>& changes)
+{
+	for (std::filesystem::path path : changes)
+	{
+		// An ignore file changes what its whole directory holds
+		if (_use_ignore_files && (path.filename() == ".gitignore" || path.filename() == ".ignore"))
+		{
+			path = path.parent_path();
+		}
+
+		const auto relative = path.lexically_relative(_folder);
+
+		if (relative.empty() || *relative.begin() == "..")
+		{
+			continue;
+		}
+
+		// Whatever was there before, a file or a whole directory, goes
+		const std::string prefix = (path / "").string();
+		_files.erase(path.string());
+
+		for (auto iter = _files.lower_bound(prefix); iter != _files.end() && iter->first.starts_with(prefix);)
+		{
+			iter = _files.erase(iter);
+		}
+
+		std::error_code error;
+		const std::filesystem::directory_entry entry(path, error);
+
+		if (error || !entry.exists(error))
+		{
+			continue;
+		}
+
+		// The depth of the entries within the path
+		size_t depth = 0;
+
+		for (const auto& part : relative)
+		{
+			depth += part != ".";
+		}
+
+		if (entry.is_directory(error) && !entry.is_symlink(error))
+		{
+			if (const auto ignores = filter_within(path))
+			{
+				list(path, *ignores, depth);
+			}
+		}
+		else if (const auto ignores = filter_within(path.parent_path()))
+		{
+			if (depth && !(*ignores && (*ignores)->is_ignored(entry)))
+			{
+				add(entry, depth - 1);
+			}
+		}
+	}
+
+	publish();
+}
+
+std::shared_ptr<const resident_tree::listing> resident_tree::snapshot() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _snapshot;
+}
+
+std::optional<std::shared_ptr<const ignore_filter>> resident_tree::filter_within(const std::filesystem::path& directory) const
+{
+	std::shared_ptr<const ignore_filter> ignores = _use_ignore_files ? ignore_filter::load(nullptr, _folder) : nullptr;
+	std::filesystem::path current = _folder;
+	size_t depth = 0;
+
+	// Down from the folder as the walk goes, which may have passed over any
+	// directory on the way
+	for (const auto& part : directory.lexically_relative(_folder))
+	{
+		if (part == ".")
+		{
+			continue;
+		}
+
+		if (part == "..")
+		{
+			return {};
+		}
+
+		current /= part;
+
+		std::error_code error;
+		const std::filesystem::directory_entry entry(current, error);
+
+		if (error || entry.is_symlink(error) || (ignores && ignores->is_ignored(entry)) || !_metadata_filter.enters(depth))
+		{
+			return {};
+		}
+
+		if (ignores)
+		{
+			ignores = ignore_filter::load(ignores, current);
+		}
+
+		++depth;
+	}
+
+	return ignores;
+}
+
+void resident_tree::list(const std::filesystem::path& directory, const std::shared_ptr<const ignore_filter>& ignores, size_t depth)
+{
+	// The filter in effect at each depth below the directory
+	std::vector<std::shared_ptr<const ignore_filter>> filters = { ignores };
+
+	std::error_code error;
+	const auto options = std::filesystem::directory_options::skip_permission_denied;
+
+	for (std::filesystem::recursive_directory_iterator iter(directory, options, error), end; !error && iter != end; iter.increment(error))
+	{
+		const std::filesystem::directory_entry& entry = *iter;
+		filters.resize(static_cast<size_t>(iter.depth()) + 1);
+
+		const auto filter = filters.back();
+		const size_t entry_depth = depth + static_cast<size_t>(iter.depth());
+
+		if (filter && filter->is_ignored(entry))
+		{
+			iter.disable_recursion_pending();
+			continue;
+		}
+
+		std::error_code type_error;
+
+		if (entry.is_directory(type_error))
+		{
+			if (!_metadata_filter.enters(entry_depth))
+			{
+				iter.disable_recursion_pending();
+			}
+			else if (filter && !entry.is_symlink(type_error))
+			{
+				filters.emplace_back(ignore_filter::load(filter, entry.path()));
+			}
+		}
+		else
+		{
+			add(entry, entry_depth);
+		}
+	}
+}
+
+void resident_tree::add(const std::filesystem::directory_entry& entry, size_t depth)
+{
+	std::error_code error;
+
+	if (!entry.is_regular_file(error) || trigram_index::is_index_file(entry.path()) || !_metadata_filter.admits(entry, depth))
+	{
+		return;
+	}
+
+	struct stat status = {};
+
+	if (stat(entry.path().c_str(), &status) == -1)
+	{
+		return;
+	}
+
+	_files[entry.path().string()] =
+	{
+		static_cast<uint64_t>(status.st_size),
+		static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec
+	};
+}
+
+void resident_tree::publish()
+{
+	auto files = std::make_shared<listing>();
+	files->reserve(_files.size());
+
+	for (const auto& [path, metadata] : _files)
+	{
+		files->push_back({ path, metadata.size, metadata.modified });
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_snapshot = std::move(files);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "file_filter.hpp"
+#include "ignore_filter.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The files under a folder a search would visit, with their size and
+// modification time, kept in memory for the queries of a daemon. A change
+// reported by the file watcher is applied where it happened: a file is
+// looked at again, a directory is listed again.
+//
+// The queries take a snapshot of the listing, which an update replaces rather
+// than changes, so a query never waits for an update nor sees half of one.
+class resident_tree
+{
+public:
+	struct file
+	{
+		std::filesystem::path path;
+		uint64_t size = 0;
+		int64_t modified = 0;
+	};
+
+	// In the order of their paths
+	using listing = std::vector<file>;
+
+	// Lists the whole folder
+	resident_tree(const std::filesystem::path& folder, bool use_ignore_files, const file_filter& metadata_filter);
+
+	// Applies the paths created, modified, moved or deleted, a directory
+	// standing for everything below it. Not to be called concurrently.
+	void update(const std::vector<std::filesystem::path>& changes);
+
+	std::shared_ptr<const listing> snapshot() const;
+
+private:
+	resident_tree(const resident_tree&) = delete;
+	resident_tree(resident_tree&&) = delete;
+	resident_tree& operator = (const resident_tree&) = delete;
+	resident_tree& operator = (resident_tree&&) = delete;
+
+	struct metadata
+	{
+		uint64_t size = 0;
+		int64_t modified = 0;
+	};
+
+	// The ignore filter for the entries of the directory, none if the
+	// directory is not searched at all
+	std::optional<std::shared_ptr<const ignore_filter>> filter_within(const std::filesystem::path& directory) const;
+
+	// Adds the files of the directory, whose entries are at the depth
+	void list(const std::filesystem::path& directory, const std::shared_ptr<const ignore_filter>& ignores, size_t depth);
+
+	// Adds the file if it is one to search
+	void add(const std::filesystem::directory_entry& entry, size_t depth);
+
+	void publish();
+
+	const std::filesystem::path _folder;
+	const bool _use_ignore_files;
+	const file_filter _metadata_filter;
+
+	// The files by their path, owned by the updating thread
+	std::map<std::string, metadata> _files;
+
+	mutable std::mutex _mutex;
+	std::shared_ptr<const listing> _snapshot;
+};
@@ -0,0 +1,237 @@
+#include "result_cache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	constexpr char cache_magic[8] = { 'F', 'S', 'R', 'E', 'S', 'L', 'T', '1' };
+	constexpr uint32_t cache_version = 1;
+
+	struct cache_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t query_size;
+		uint64_t entry_count;
+	};
+
+	struct entry_header
+	{
+		uint64_t inode;
+		uint64_t size;
+		int64_t modified;
+		uint32_t path_size;
+		uint32_t results_size;
+	};
+
+	static_assert(sizeof(cache_header) == 24);
+	static_assert(sizeof(entry_header) == 32);
+
+	// FNV-1a, the file name only has to tell the queries apart
+	uint64_t query_hash(std::string_view query)
+	{
+		uint64_t hash = 0xCBF29CE484222325;
+
+		for (const char c : query)
+		{
+			hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3;
+		}
+
+		return hash;
+	}
+
+	std::filesystem::path cache_path(const std::filesystem::path& directory, std::string_view query)
+	{
+		char name[17] = {};
+		const uint64_t hash = query_hash(query);
+
+		for (size_t i = 0; i < 16; ++i)
+		{
+			name[i] = "0123456789abcdef"[(hash >> (60 - i * 4)) & 0xF];
+		}
+
+		return directory / (std::string(name) + ".cache");
+	}
+
+	// Copies the next bytes out of the contents, false if they run out
+	bool read_bytes(std::string_view& contents, void* data, size_t size)
+	{
+		if (contents.size() < size)
+		{
+			return false;
+		}
+
+		std::memcpy(data, contents.data(), size);
+		contents.remove_prefix(size);
+		return true;
+	}
+
+	void write_bytes(std::ofstream& output, const void* data, size_t size)
+	{
+		output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	}
+}
+
+result_cache::result_cache(const std::filesystem::path& directory, std::string_view query) :
+	_path(cache_path(directory, query)),
+	_query(query)
+{
+	std::ifstream file(_path, std::ios::binary);
+
+	if (!file)
+	{
+		return;
+	}
+
+	const std::string data(std::istreambuf_iterator<char>(file), {});
+	std::string_view contents(data);
+
+	cache_header header = {};
+
+	// A cache of another version, or of a query with the same hash, is
+	// started over
+	if (!read_bytes(contents, &header, sizeof(header)) ||
+		std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) ||
+		header.version != cache_version ||
+		!contents.starts_with(_query) ||
+		header.query_size != _query.size())
+	{
+		return;
+	}
+
+	contents.remove_prefix(_query.size());
+
+	for (uint64_t i = 0; i < header.entry_count; ++i)
+	{
+		entry_header entry = {};
+
+		if (!read_bytes(contents, &entry, sizeof(entry)) || contents.size() < size_t(entry.path_size) + entry.results_size)
+		{
+			_loaded.clear();
+			return;
+		}
+
+		std::string path(contents.substr(0, entry.path_size));
+		contents.remove_prefix(entry.path_size);
+
+		_loaded[std::move(path)] = { { entry.inode, entry.size, entry.modified }, std::string(contents.substr(0, entry.results_size)) };
+		contents.remove_prefix(entry.results_size);
+	}
+}
+
+std::optional<std::string> result_cache::lookup(const std::filesystem::path& path, std::optional<file_key>& key)
+{
+	key.reset();
+
+#ifdef _WIN32
+	std::error_code error;
+	const uint64_t size = std::filesystem::file_size(path, error);
+
+	if (error)
+	{
+		return {};
+	}
+
+	const auto modified = std::filesystem::last_write_time(path, error);
+
+	if (error)
+	{
+		return {};
+	}
+
+	key = file_key{ 0, size, modified.time_since_epoch().count() };
+#else
+	struct stat status = {};
+
+	if (stat(path.c_str(), &status) == -1)
+	{
+		return {};
+	}
+
+	// macOS names the time apart from the other systems
+#if defined(__APPLE__)
+	const timespec& modified = status.st_mtimespec;
+#else
+	const timespec& modified = status.st_mtim;
+#endif
+
+	key = file_key
+	{
+		static_cast<uint64_t>(status.st_ino),
+		static_cast<uint64_t>(status.st_size),
+		static_cast<int64_t>(modified.tv_sec) * 1000000000 + modified.tv_nsec
+	};
+#endif
+
+	const auto iter = _loaded.find(path.string());
+
+	if (iter == _loaded.cend() || !(iter->second.key == *key))
+	{
+		return {};
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_current.insert(*iter);
+	}
+
+	return iter->second.results;
+}
+
+void result_cache::store(const std::filesystem::path& path, const file_key& key, std::string_view results)
+{
+	if (results.size() > max_results_size)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_current[path.string()] = { key, std::string(results) };
+}
+
+void result_cache::save() const
+{
+	std::filesystem::create_directories(_path.parent_path());
+
+	cache_header header = {};
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.query_size = static_cast<uint32_t>(_query.size());
+	header.entry_count = _current.size();
+
+	// Written aside and renamed over the cache, a query never sees half of it
+	const std::filesystem::path temporary_path = _path.string() + ".tmp";
+
+	{
+		std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+		output.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+		write_bytes(output, &header, sizeof(header));
+		write_bytes(output, _query.data(), _query.size());
+
+		for (const auto& [path, entry] : _current)
+		{
+			const entry_header record =
+			{
+				entry.key.inode,
+				entry.key.size,
+				entry.key.modified,
+				static_cast<uint32_t>(path.size()),
+				static_cast<uint32_t>(entry.results.size())
+			};
+
+			write_bytes(output, &record, sizeof(record));
+			write_bytes(output, path.data(), path.size());
+			write_bytes(output, entry.results.data(), entry.results.size());
+		}
+	}
+
+	std::filesystem::rename(temporary_path, _path);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// The results of one query for each file it searched, kept on disk so that a
+// repeat of the query takes the results of the files that did not change from
+// the cache without opening them. A file counts as unchanged while its inode,
+// size and modification time are the same.
+//
+// Each query has a file of its own in the cache directory, named after a hash
+// of everything that shapes the results. Saving keeps only the files of the
+// latest run, so the cache follows the tree rather than grow with it.
+class result_cache
+{
+public:
+	// Identifies a version of a file. Windows has no inode to offer.
+	struct file_key
+	{
+		uint64_t inode = 0;
+		uint64_t size = 0;
+		int64_t modified = 0;
+
+		bool operator == (const file_key&) const = default;
+	};
+
+	// Results longer than this are not worth keeping
+	static constexpr size_t max_results_size = 0x100000; // 1 MiB
+
+	// Loads the results of the query, if the directory has any
+	result_cache(const std::filesystem::path& directory, std::string_view query);
+
+	// The cached results if the file did not change, the entry is then kept.
+	// The key of the file is taken either way, unless it cannot be had.
+	std::optional<std::string> lookup(const std::filesystem::path& path, std::optional<file_key>& key);
+
+	// The results of a file searched anew. Safe to call from several threads.
+	void store(const std::filesystem::path& path, const file_key& key, std::string_view results);
+
+	// Writes the entries looked up or stored in this run
+	void save() const;
+
+private:
+	result_cache(const result_cache&) = delete;
+	result_cache(result_cache&&) = delete;
+	result_cache& operator = (const result_cache&) = delete;
+	result_cache& operator = (result_cache&&) = delete;
+
+	struct entry
+	{
+		file_key key;
+		std::string results;
+	};
+
+	const std::filesystem::path _path;
+	const std::string _query;
+
+	// Read only while searching
+	std::unordered_map<std::string, entry> _loaded;
+
+	std::mutex _mutex;
+	std::unordered_map<std::string, entry> _current;
+};
@@ -0,0 +1,171 @@
+#include "search_stats.hpp"
+
+#include <iomanip>
+#include <string_view>
+
+namespace
+{
+	constexpr std::string_view phase_names[] = { "walk", "read", "match", "output" };
+
+	double seconds(search_stats::clock::duration duration)
+	{
+		return std::chrono::duration<double>(duration).count();
+	}
+
+	double mebibytes(uint64_t bytes)
+	{
+		return static_cast<double>(bytes) / (1 << 20);
+	}
+}
+
+search_stats::search_stats() :
+	_start(clock::now())
+{
+}
+
+search_stats::counters& search_stats::local()
+{
+	// A thread finds its counters again without the lock, as long as it is
+	// counting for the same stats
+	thread_local const search_stats* owner = nullptr;
+	thread_local counters* cached = nullptr;
+
+	if (owner != this)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_threads.push_back(std::make_unique<counters>());
+		cached = _threads.back().get();
+		owner = this;
+	}
+
+	return *cached;
+}
+
+void search_stats::report(std::ostream& stream) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	const clock::duration wall_time = clock::now() - _start;
+	counters total;
+
+	for (const auto& thread : _threads)
+	{
+		total.files_visited += thread->files_visited;
+		total.files_cached += thread->files_cached;
+		total.files_ignored += thread->files_ignored;
+		total.files_filtered += thread->files_filtered;
+		total.files_binary += thread->files_binary;
+		total.bytes_scanned += thread->bytes_scanned;
+
+		for (size_t i = 0; i < phase_count; ++i)
+		{
+			total.time[i] += thread->time[i];
+		}
+	}
+
+	clock::duration busy_time = {};
+
+	for (const clock::duration& time : total.time)
+	{
+		busy_time += time;
+	}
+
+	const auto flags = stream.flags();
+	const auto precision = stream.precision();
+
+	stream << std::fixed << std::setprecision(3);
+	stream << "files visited    " << total.files_visited << std::endl;
+	stream << "files cached     " << total.files_cached << std::endl;
+	stream << "files skipped    " << total.files_ignored + total.files_filtered + total.files_binary
+		<< " (" << total.files_ignored << " ignored, " << total.files_filtered << " filtered, "
+		<< total.files_binary << " binary)" << std::endl;
+	stream << "bytes scanned    " << mebibytes(total.bytes_scanned) << " MiB" << std::endl;
+	stream << "wall time        " << seconds(wall_time) << " s" << std::endl;
+	stream << "throughput       " << mebibytes(total.bytes_scanned) / seconds(wall_time) << " MiB/s" << std::endl;
+
+	// The phases add up the time of every thread
+	for (size_t i = 0; i < phase_count; ++i)
+	{
+		const double share = busy_time.count() ? 100.0 * seconds(total.time[i]) / seconds(busy_time) : 0.0;
+
+		stream << std::left << std::setw(17) << std::string(phase_names[i]) + " time" << std::right
+			<< seconds(total.time[i]) << " s (" << std::setprecision(1) << share << "%)" << std::setprecision(3) << std::endl;
+	}
+
+	if (_threads.size() > 1)
+	{
+		for (size_t i = 0; i < _threads.size(); ++i)
+		{
+			const counters& thread = *_threads[i];
+			clock::duration thread_time = {};
+
+			for (const clock::duration& time : thread.time)
+			{
+				thread_time += time;
+			}
+
+			stream << "thread " << std::left << std::setw(10) << i << std::right
+				<< seconds(thread_time) << " s busy, "
+				<< thread.files_visited << " files, "
+				<< mebibytes(thread.bytes_scanned) << " MiB" << std::endl;
+		}
+	}
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+phase_timer::phase_timer(search_stats* stats, search_stats::phase phase) :
+	_phase(phase)
+{
+	if (!stats)
+	{
+		return;
+	}
+
+	_counters = &stats->local();
+	_outer = _counters->timer;
+	_counters->timer = this;
+
+	if (_outer)
+	{
+		_outer->pause();
+	}
+
+	resume();
+}
+
+phase_timer::~phase_timer()
+{
+	if (!_counters)
+	{
+		return;
+	}
+
+	pause();
+	_counters->timer = _outer;
+
+	if (_outer)
+	{
+		_outer->resume();
+	}
+}
+
+void phase_timer::pause()
+{
+	if (_running)
+	{
+		_counters->time[_phase] += search_stats::clock::now() - _start;
+		_running = false;
+	}
+}
+
+void phase_timer::resume()
+{
+	if (!_running)
+	{
+		_start = search_stats::clock::now();
+		_running = true;
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+class phase_timer;
+
+// What a search spent its time on and how much it got through. Every thread
+// counts into counters of its own, which are only added up for the report
+// once the search is over, so counting takes a couple of clock reads per
+// file and no contention.
+class search_stats
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	enum phase
+	{
+		walk,   // listing directories and filtering their entries
+		read,   // opening and mapping files, or waiting for their reads
+		match,  // searching the contents, page faults of mapped files included
+		output, // writing the results
+		phase_count
+	};
+
+	struct counters
+	{
+		uint64_t files_visited = 0;
+		uint64_t files_cached = 0;
+		uint64_t files_ignored = 0;
+		uint64_t files_filtered = 0;
+		uint64_t files_binary = 0;
+		uint64_t bytes_scanned = 0;
+		std::array<clock::duration, phase_count> time = {};
+
+		// The innermost timer running on the thread
+		phase_timer* timer = nullptr;
+	};
+
+	search_stats();
+
+	// The counters of the calling thread
+	counters& local();
+
+	// Writes the totals, and each thread's share when there were several
+	void report(std::ostream& stream) const;
+
+private:
+	search_stats(const search_stats&) = delete;
+	search_stats(search_stats&&) = delete;
+	search_stats& operator = (const search_stats&) = delete;
+	search_stats& operator = (search_stats&&) = delete;
+
+	const clock::time_point _start;
+	mutable std::mutex _mutex;
+	std::vector<std::unique_ptr<counters>> _threads;
+};
+
+// Adds the time it is in scope to a phase of the calling thread, nothing
+// without stats. A timer started within another pauses the outer one until it
+// goes out of scope, so no time is counted twice.
+class phase_timer
+{
+public:
+	phase_timer(search_stats* stats, search_stats::phase phase);
+	~phase_timer();
+
+private:
+	phase_timer(const phase_timer&) = delete;
+	phase_timer(phase_timer&&) = delete;
+	phase_timer& operator = (const phase_timer&) = delete;
+	phase_timer& operator = (phase_timer&&) = delete;
+
+	void pause();
+	void resume();
+
+	search_stats::counters* _counters = nullptr;
+	phase_timer* _outer = nullptr;
+	const search_stats::phase _phase;
+	search_stats::clock::time_point _start;
+	bool _running = false;
+};
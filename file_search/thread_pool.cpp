@@ -0,0 +1,180 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	thread_local const thread_pool* current_pool = nullptr;
+	thread_local size_t current_index = 0;
+}
+
+thread_pool::thread_pool(size_t thread_count)
+{
+	thread_count = std::max(thread_count, size_t(1));
+
+	for (size_t i = 0; i < thread_count; ++i)
+	{
+		_queues.emplace_back(std::make_unique<work_queue>());
+	}
+
+	for (size_t i = 0; i < thread_count; ++i)
+	{
+		_threads.emplace_back(&thread_pool::run, this, i);
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_work_available.notify_all();
+
+	for (std::thread& thread : _threads)
+	{
+		thread.join();
+	}
+}
+
+void thread_pool::submit(task&& work)
+{
+	const size_t index = current_pool == this ?
+		current_index :
+		_next_queue++ % _queues.size();
+
+	++_unfinished;
+
+	{
+		std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+		_queues[index]->tasks.emplace_back(std::move(work));
+	}
+
+	++_queued;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+	}
+
+	_work_available.notify_one();
+}
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_work_done.wait(lock, [this]()
+	{
+		return _unfinished == 0;
+	});
+}
+
+void thread_pool::help_until(std::latch& done)
+{
+	// Any thread other than a worker steals from every queue
+	const size_t index = current_pool == this ? current_index : _queues.size();
+
+	while (!done.try_wait())
+	{
+		task work;
+
+		if (!(index < _queues.size() && try_pop(index, work)) && !try_steal(index, work))
+		{
+			done.wait();
+			return;
+		}
+
+		execute(work);
+	}
+}
+
+size_t thread_pool::size() const
+{
+	return _threads.size();
+}
+
+void thread_pool::run(size_t index)
+{
+	current_pool = this;
+	current_index = index;
+
+	while (true)
+	{
+		task work;
+
+		if (try_pop(index, work) || try_steal(index, work))
+		{
+			execute(work);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		_work_available.wait(lock, [this]()
+		{
+			return _stop || _queued > 0;
+		});
+
+		if (_stop && _queued == 0)
+		{
+			return;
+		}
+	}
+}
+
+void thread_pool::execute(task& work)
+{
+	--_queued;
+
+	try
+	{
+		work();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Task failed: " << e.what() << std::endl;
+	}
+
+	if (--_unfinished == 0)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_work_done.notify_all();
+	}
+}
+
+bool thread_pool::try_pop(size_t index, task& work)
+{
+	work_queue& queue = *_queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.tasks.empty())
+	{
+		return false;
+	}
+
+	work = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool thread_pool::try_steal(size_t index, task& work)
+{
+	// An index past the queues steals from all of them
+	for (size_t i = index < _queues.size() ? 1 : 0; i < _queues.size(); ++i)
+	{
+		work_queue& queue = *_queues[(index + i) % _queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty())
+		{
+			continue;
+		}
+
+		work = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A work-stealing thread pool. Each worker owns a queue and pops its own work
+// from the back, idle workers steal from the front of the other queues.
+class thread_pool
+{
+public:
+	using task = std::function<void()>;
+
+	explicit thread_pool(size_t thread_count);
+	~thread_pool();
+
+	// Queues a task. When called from a worker the task goes to the worker's
+	// own queue, which keeps the work of a directory close to the thread that
+	// enumerated it.
+	void submit(task&& work);
+
+	// Blocks until every submitted task, including the ones they submit, is done
+	void wait();
+
+	// Runs queued tasks on the calling thread until the latch is released, a
+	// worker's own tasks first. Once none are queued the tasks counted by the
+	// latch are all running, and it blocks. A task may thus wait for the ones
+	// it submits without tying up its worker or deadlocking the pool.
+	void help_until(std::latch& done);
+
+	size_t size() const;
+
+private:
+	thread_pool(const thread_pool&) = delete;
+	thread_pool(thread_pool&&) = delete;
+	thread_pool& operator = (const thread_pool&) = delete;
+	thread_pool& operator = (thread_pool&&) = delete;
+
+	struct work_queue
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+
+	void run(size_t index);
+	void execute(task& work);
+	bool try_pop(size_t index, task& work);
+	bool try_steal(size_t index, task& work);
+
+	std::vector<std::unique_ptr<work_queue>> _queues;
+	std::vector<std::thread> _threads;
+
+	std::mutex _mutex;
+	std::condition_variable _work_available;
+	std::condition_variable _work_done;
+	std::atomic<size_t> _queued = 0;
+	std::atomic<size_t> _unfinished = 0;
+	std::atomic<size_t> _next_queue = 0;
+	bool _stop = false;
+};
@@ -0,0 +1,1058 @@
+#include "trigram_index.hpp"
+#include "content_type.hpp"
+#include "decompressor.hpp"
+#include "ignore_filter.hpp"
+#include "memory_mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "utf16.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	constexpr char index_magic[8] = { 'F', 'S', 'T', 'R', 'I', 'D', 'X', '1' };
+	constexpr uint32_t index_version = 4;
+	constexpr size_t batch_size = 0x400;
+	constexpr size_t deduplicate_threshold = 0x400000;
+	constexpr size_t max_segments = 8;
+
+	constexpr uint32_t deleted_flag = 1;
+
+	struct index_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t file_count;
+		uint64_t trigram_count;
+		uint64_t generation; // Shared by a base and the segments applying to it
+		uint64_t files_offset;
+		uint64_t trigrams_offset;
+		uint64_t paths_offset;
+		uint64_t postings_offset;
+		uint64_t size;
+	};
+
+	struct file_entry
+	{
+		uint64_t path_offset;
+		uint32_t path_size;
+		uint32_t flags;
+		uint64_t size;
+		int64_t modified;
+	};
+
+	struct trigram_entry
+	{
+		uint32_t trigram;
+		uint32_t count;
+		uint64_t postings_offset;
+	};
+
+	static_assert(sizeof(index_header) == 72);
+	static_assert(sizeof(file_entry) == 32);
+	static_assert(sizeof(trigram_entry) == 16);
+
+	struct posting_list
+	{
+		std::string bytes;
+		uint32_t last = 0;
+		uint32_t count = 0;
+	};
+
+	uint8_t fold_case(uint8_t c)
+	{
+		return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+	}
+
+	void append_varint(std::string& bytes, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			bytes.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+
+		bytes.push_back(static_cast<char>(value));
+	}
+
+	uint32_t read_varint(const uint8_t*& data)
+	{
+		uint32_t value = 0;
+
+		for (int shift = 0; ; shift += 7)
+		{
+			const uint8_t byte = *data++;
+			value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80))
+			{
+				return value;
+			}
+		}
+	}
+
+	// The distinct case folded trigrams of text added a part at a time, line
+	// feeds excluded
+	class trigram_collector
+	{
+	public:
+		void add(std::string_view text)
+		{
+			for (char c : text)
+			{
+				if (c == '\n')
+				{
+					_valid = 0;
+					continue;
+				}
+
+				_trigram = ((_trigram << 8) | fold_case(static_cast<uint8_t>(c))) & 0xFFFFFF;
+
+				if (++_valid < 3)
+				{
+					continue;
+				}
+
+				_trigrams.push_back(_trigram);
+
+				if (_trigrams.size() >= _threshold)
+				{
+					deduplicate();
+
+					// Binary text can hold millions of distinct trigrams, which
+					// would be sorted again for each one after
+					_threshold = std::max(deduplicate_threshold, _trigrams.size() * 2);
+				}
+			}
+		}
+
+		std::vector<uint32_t> finish()
+		{
+			deduplicate();
+			return std::move(_trigrams);
+		}
+
+	private:
+		void deduplicate()
+		{
+			std::sort(_trigrams.begin(), _trigrams.end());
+			_trigrams.erase(std::unique(_trigrams.begin(), _trigrams.end()), _trigrams.end());
+		}
+
+		std::vector<uint32_t> _trigrams;
+		size_t _threshold = deduplicate_threshold;
+		uint32_t _trigram = 0;
+		size_t _valid = 0;
+	};
+
+	// The trigrams of the text a search looks at: compressed contents
+	// decompressed if the format is built in, UTF-16 converted to UTF-8 a
+	// block at a time, anything else as it is
+	std::vector<uint32_t> extract_trigrams(std::string_view contents)
+	{
+		trigram_collector collector;
+		const compression format = detect_compression(contents);
+
+		if (format != compression::none && can_decompress(format))
+		{
+			decompressor stream(contents, format);
+
+			// The search reports the lines before corrupt or truncated data,
+			// which are indexed the same
+			try
+			{
+				for (std::string_view block = stream.next(); !block.empty(); block = stream.next())
+				{
+					collector.add(block);
+				}
+			}
+			catch (const std::exception&)
+			{
+			}
+		}
+		else if (has_utf16_bom(contents))
+		{
+			constexpr size_t block_size = 0x100000; // 1 MiB, an even size
+
+			for (size_t offset = 0; offset < contents.size();)
+			{
+				size_t size = std::min(block_size, contents.size() - offset);
+
+				// A surrogate pair is not split between the blocks
+				if (offset + size < contents.size() && size >= 2 &&
+					(static_cast<uint8_t>(contents[offset + size - 1]) & 0xFC) == 0xD8)
+				{
+					size -= 2;
+				}
+
+				collector.add(utf16_to_utf8(contents.substr(offset, size)));
+				offset += size;
+			}
+		}
+		else
+		{
+			collector.add(contents);
+		}
+
+		return collector.finish();
+	}
+
+	std::vector<uint32_t> literal_trigrams(std::string_view literal)
+	{
+		std::vector<uint32_t> trigrams;
+
+		for (size_t i = 0; i + 3 <= literal.size(); ++i)
+		{
+			trigrams.push_back(
+				static_cast<uint32_t>(fold_case(static_cast<uint8_t>(literal[i]))) << 16 |
+				static_cast<uint32_t>(fold_case(static_cast<uint8_t>(literal[i + 1]))) << 8 |
+				static_cast<uint32_t>(fold_case(static_cast<uint8_t>(literal[i + 2]))));
+		}
+
+		std::sort(trigrams.begin(), trigrams.end());
+		trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+		return trigrams;
+	}
+
+	// Extracts the trigrams of the files in parallel, a file which cannot be
+	// read has none
+	std::vector<std::vector<uint32_t>> extract_all(
+		thread_pool& pool,
+		const std::vector<std::filesystem::directory_entry>& files)
+	{
+		std::vector<std::vector<uint32_t>> trigrams(files.size());
+
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			pool.submit([&, i]()
+			{
+				try
+				{
+					memory_mapped_file file(files[i].path());
+					trigrams[i] = extract_trigrams(file.data());
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "Failed to index: " << files[i].path() << ": " << e.what() << std::endl;
+				}
+			});
+		}
+
+		pool.wait();
+		return trigrams;
+	}
+
+	std::string relative_path(const std::filesystem::path& folder, const std::filesystem::path& path)
+	{
+		const std::string relative = path.lexically_relative(folder).generic_string();
+		return relative == "." ? std::string() : relative;
+	}
+
+	int64_t modified_time(const std::filesystem::directory_entry& entry)
+	{
+		std::error_code error;
+		return entry.last_write_time(error).time_since_epoch().count();
+	}
+
+	// The ignore filter for the entries of a directory below the folder, as
+	// the walk from the folder loads it, none if the walk does not enter the
+	// directory: it or one above it is excluded or a link
+	std::optional<std::shared_ptr<const ignore_filter>> filter_below(
+		const std::filesystem::path& folder,
+		const std::filesystem::path& directory)
+	{
+		std::shared_ptr<const ignore_filter> ignores = ignore_filter::load(nullptr, folder);
+		std::filesystem::path current = folder;
+
+		for (const auto& part : directory.lexically_relative(folder))
+		{
+			if (part == ".")
+			{
+				continue;
+			}
+
+			if (part == "..")
+			{
+				return {};
+			}
+
+			current /= part;
+
+			std::error_code error;
+			const std::filesystem::directory_entry entry(current, error);
+
+			if (error || entry.is_symlink(error) || ignores->is_ignored(entry))
+			{
+				return {};
+			}
+
+			ignores = ignore_filter::load(ignores, current);
+		}
+
+		return ignores;
+	}
+
+	// Visits the regular files below the directory, but for those the filter
+	// for its entries excludes, if any
+	template <typename Visit>
+	void walk(
+		const std::filesystem::path& directory,
+		const std::shared_ptr<const ignore_filter>& ignores,
+		std::error_code& error,
+		Visit&& visit)
+	{
+		// The filter in effect at each depth below the directory
+		std::vector<std::shared_ptr<const ignore_filter>> filters = { ignores };
+		const auto options = std::filesystem::directory_options::skip_permission_denied;
+
+		for (std::filesystem::recursive_directory_iterator iter(directory, options, error), end; !error && iter != end; iter.increment(error))
+		{
+			const std::filesystem::directory_entry& entry = *iter;
+			filters.resize(static_cast<size_t>(iter.depth()) + 1);
+
+			const auto filter = filters.back();
+
+			if (filter && filter->is_ignored(entry))
+			{
+				iter.disable_recursion_pending();
+				continue;
+			}
+
+			std::error_code type_error;
+
+			if (entry.is_directory(type_error))
+			{
+				if (filter && !entry.is_symlink(type_error))
+				{
+					filters.emplace_back(ignore_filter::load(filter, entry.path()));
+				}
+
+				continue;
+			}
+
+			visit(entry);
+		}
+	}
+
+	std::filesystem::path segment_path(const std::filesystem::path& folder, size_t number)
+	{
+		return trigram_index::default_path(folder).string() + '.' + std::to_string(number);
+	}
+
+	// A base written later than any segment around can never pick them up
+	uint64_t new_generation()
+	{
+		return static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+	}
+
+	void remove_segments(const std::filesystem::path& folder)
+	{
+		const std::string prefix = trigram_index::default_path({}).filename().string() + '.';
+		std::error_code error;
+
+		for (const auto& entry : std::filesystem::directory_iterator(folder, error))
+		{
+			if (entry.path().filename().string().starts_with(prefix))
+			{
+				std::filesystem::remove(entry.path(), error);
+			}
+		}
+	}
+
+	template <typename T>
+	const T* at(std::string_view data, uint64_t offset)
+	{
+		return reinterpret_cast<const T*>(data.data() + offset);
+	}
+
+	bool is_valid_segment(std::string_view data)
+	{
+		if (data.size() < sizeof(index_header))
+		{
+			return false;
+		}
+
+		const index_header* header = at<index_header>(data, 0);
+
+		return !std::memcmp(header->magic, index_magic, sizeof(index_magic)) &&
+			header->version == index_version &&
+			header->size == data.size();
+	}
+
+	// Reads the tables of a mapped base or segment in place
+	class segment_view
+	{
+	public:
+		explicit segment_view(std::string_view data) :
+			_data(data)
+		{
+		}
+
+		const index_header& header() const
+		{
+			return *at<index_header>(_data, 0);
+		}
+
+		const file_entry& file(uint32_t id) const
+		{
+			return at<file_entry>(_data, header().files_offset)[id];
+		}
+
+		std::string_view path(uint32_t id) const
+		{
+			const file_entry& entry = file(id);
+			return _data.substr(header().paths_offset + entry.path_offset, entry.path_size);
+		}
+
+		std::vector<uint32_t> postings(uint32_t trigram) const
+		{
+			const trigram_entry* begin = at<trigram_entry>(_data, header().trigrams_offset);
+			const trigram_entry* end = begin + header().trigram_count;
+
+			const trigram_entry* entry = std::lower_bound(begin, end, trigram, [](const trigram_entry& entry, uint32_t trigram)
+			{
+				return entry.trigram < trigram;
+			});
+
+			if (entry == end || entry->trigram != trigram)
+			{
+				return {};
+			}
+
+			return decode(*entry);
+		}
+
+		// Calls back with each trigram and its posting list, in trigram order
+		template <typename F>
+		void for_each_posting_list(F&& callback) const
+		{
+			const trigram_entry* entries = at<trigram_entry>(_data, header().trigrams_offset);
+
+			for (uint64_t i = 0; i < header().trigram_count; ++i)
+			{
+				callback(entries[i].trigram, decode(entries[i]));
+			}
+		}
+
+		// The ids of the files containing every one of the trigrams
+		std::vector<uint32_t> candidates(const std::vector<uint32_t>& trigrams) const
+		{
+			std::vector<uint32_t> ids;
+
+			if (trigrams.empty())
+			{
+				ids.resize(header().file_count);
+
+				for (uint32_t id = 0; id < header().file_count; ++id)
+				{
+					ids[id] = id;
+				}
+			}
+
+			for (size_t i = 0; i < trigrams.size(); ++i)
+			{
+				const std::vector<uint32_t> list = postings(trigrams[i]);
+
+				if (!i)
+				{
+					ids = list;
+				}
+				else
+				{
+					std::vector<uint32_t> intersection;
+					std::set_intersection(ids.cbegin(), ids.cend(), list.cbegin(), list.cend(), std::back_inserter(intersection));
+					ids.swap(intersection);
+				}
+
+				if (ids.empty())
+				{
+					break;
+				}
+			}
+
+			return ids;
+		}
+
+	private:
+		std::vector<uint32_t> decode(const trigram_entry& entry) const
+		{
+			std::vector<uint32_t> ids;
+			ids.reserve(entry.count);
+
+			const uint8_t* postings = reinterpret_cast<const uint8_t*>(_data.data() + entry.postings_offset);
+			uint32_t id = 0;
+
+			for (uint32_t i = 0; i < entry.count; ++i)
+			{
+				id += read_varint(postings);
+				ids.push_back(id);
+			}
+
+			return ids;
+		}
+
+		std::string_view _data;
+	};
+
+	// Collects the files and the posting lists of a base or a segment. The
+	// ids of the files must be added to each posting list in order.
+	class index_writer
+	{
+	public:
+		uint32_t add_file(std::string_view path, uint64_t size, int64_t modified, uint32_t flags)
+		{
+			file_entry entry = {};
+			entry.path_offset = _paths.size();
+			entry.path_size = static_cast<uint32_t>(path.size());
+			entry.flags = flags;
+			entry.size = size;
+			entry.modified = modified;
+
+			_files.push_back(entry);
+			_paths += path;
+
+			return static_cast<uint32_t>(_files.size() - 1);
+		}
+
+		void add_posting(uint32_t trigram, uint32_t id)
+		{
+			posting_list& list = _postings[trigram];
+			append_varint(list.bytes, id - list.last);
+			list.last = id;
+			++list.count;
+		}
+
+		void add_trigrams(uint32_t id, const std::vector<uint32_t>& trigrams)
+		{
+			for (uint32_t trigram : trigrams)
+			{
+				add_posting(trigram, id);
+			}
+		}
+
+		size_t file_count() const
+		{
+			return _files.size();
+		}
+
+		size_t trigram_count() const
+		{
+			return _postings.size();
+		}
+
+		// Written aside and renamed over the target, queries never see half of it
+		void write(const std::filesystem::path& target, uint64_t generation) const
+		{
+			std::vector<uint32_t> trigrams;
+			trigrams.reserve(_postings.size());
+
+			for (const auto& [trigram, list] : _postings)
+			{
+				trigrams.push_back(trigram);
+			}
+
+			std::sort(trigrams.begin(), trigrams.end());
+
+			index_header header = {};
+			std::memcpy(header.magic, index_magic, sizeof(index_magic));
+			header.version = index_version;
+			header.file_count = static_cast<uint32_t>(_files.size());
+			header.trigram_count = trigrams.size();
+			header.generation = generation;
+			header.files_offset = sizeof(index_header);
+			header.trigrams_offset = header.files_offset + _files.size() * sizeof(file_entry);
+			header.paths_offset = header.trigrams_offset + trigrams.size() * sizeof(trigram_entry);
+			header.postings_offset = header.paths_offset + _paths.size();
+
+			std::vector<trigram_entry> table;
+			table.reserve(trigrams.size());
+			uint64_t postings_size = 0;
+
+			for (uint32_t trigram : trigrams)
+			{
+				const posting_list& list = _postings.at(trigram);
+				table.push_back({ trigram, list.count, header.postings_offset + postings_size });
+				postings_size += list.bytes.size();
+			}
+
+			header.size = header.postings_offset + postings_size;
+
+			const std::filesystem::path temporary_path = target.string() + ".tmp";
+
+			{
+				std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+				output.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+				write_bytes(output, &header, sizeof(header));
+				write_bytes(output, _files.data(), _files.size() * sizeof(file_entry));
+				write_bytes(output, table.data(), table.size() * sizeof(trigram_entry));
+				write_bytes(output, _paths.data(), _paths.size());
+
+				for (uint32_t trigram : trigrams)
+				{
+					const posting_list& list = _postings.at(trigram);
+					write_bytes(output, list.bytes.data(), list.bytes.size());
+				}
+			}
+
+			std::filesystem::rename(temporary_path, target);
+		}
+
+	private:
+		static void write_bytes(std::ofstream& output, const void* data, size_t size)
+		{
+			output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		}
+
+		std::vector<file_entry> _files;
+		std::string _paths;
+		std::unordered_map<uint32_t, posting_list> _postings;
+	};
+}
+
+std::filesystem::path trigram_index::default_path(const std::filesystem::path& folder)
+{
+	return folder / ".file_search_index";
+}
+
+bool trigram_index::is_index_file(const std::filesystem::path& path)
+{
+	return path.filename().string().starts_with(default_path({}).filename().string());
+}
+
+void trigram_index::build(const std::filesystem::path& folder, bool use_ignore_files, size_t thread_count)
+{
+	index_writer writer;
+	std::vector<std::filesystem::directory_entry> batch;
+	thread_pool pool(thread_count);
+
+	// Trigrams are extracted in parallel, a batch at a time, and added in
+	// the order of the files so that the posting lists stay sorted
+	const auto flush_batch = [&]()
+	{
+		const std::vector<std::vector<uint32_t>> trigrams = extract_all(pool, batch);
+
+		for (size_t i = 0; i < batch.size(); ++i)
+		{
+			std::error_code error;
+			const uint32_t id = writer.add_file(
+				relative_path(folder, batch[i].path()),
+				batch[i].file_size(error),
+				modified_time(batch[i]),
+				0);
+
+			writer.add_trigrams(id, trigrams[i]);
+		}
+
+		batch.clear();
+	};
+
+	std::error_code error;
+
+	walk(folder, use_ignore_files ? ignore_filter::load(nullptr, folder) : nullptr, error, [&](const std::filesystem::directory_entry& entry)
+	{
+		std::error_code type_error;
+
+		if (!entry.is_regular_file(type_error) || is_index_file(entry.path()))
+		{
+			return;
+		}
+
+		batch.push_back(entry);
+
+		if (batch.size() >= batch_size)
+		{
+			flush_batch();
+		}
+	});
+
+	if (error)
+	{
+		throw std::filesystem::filesystem_error("cannot list the folder", folder, error);
+	}
+
+	flush_batch();
+
+	writer.write(default_path(folder), new_generation());
+	remove_segments(folder);
+
+	std::cout << "Indexed " << writer.file_count() << " files, " << writer.trigram_count() << " trigrams." << std::endl;
+}
+
+void trigram_index::update(
+	const std::filesystem::path& folder,
+	const std::vector<std::filesystem::path>& changes,
+	bool use_ignore_files,
+	size_t thread_count)
+{
+	const trigram_index index(folder);
+	const std::vector<std::vector<bool>> live = index.live_files();
+
+	struct indexed_file
+	{
+		std::string_view path;
+		uint64_t size;
+		int64_t modified;
+
+		bool operator < (const indexed_file& other) const
+		{
+			return path < other.path;
+		}
+	};
+
+	// The current state of every file in the index, sorted by path so that
+	// the files below a directory are a range
+	std::vector<indexed_file> indexed;
+
+	for (size_t i = 0; i < index._segments.size(); ++i)
+	{
+		const segment_view segment(index._segments[i]->data());
+
+		for (uint32_t id = 0; id < segment.header().file_count; ++id)
+		{
+			if (live[i][id])
+			{
+				indexed.push_back({ segment.path(id), segment.file(id).size, segment.file(id).modified });
+			}
+		}
+	}
+
+	std::sort(indexed.begin(), indexed.end());
+
+	std::vector<std::filesystem::directory_entry> modified;
+	std::unordered_set<std::string> present;
+	std::set<std::string> deleted;
+
+	const auto visit = [&](const std::filesystem::directory_entry& entry)
+	{
+		std::error_code error;
+
+		if (!entry.is_regular_file(error) || is_index_file(entry.path()))
+		{
+			return;
+		}
+
+		std::string path = relative_path(folder, entry.path());
+		const indexed_file key = { path, 0, 0 };
+		const auto iter = std::lower_bound(indexed.cbegin(), indexed.cend(), key);
+
+		if (iter == indexed.cend() || iter->path != path ||
+			iter->size != entry.file_size(error) || iter->modified != modified_time(entry))
+		{
+			modified.push_back(entry);
+		}
+
+		present.emplace(std::move(path));
+	};
+
+	for (std::filesystem::path change : changes)
+	{
+		// An ignore file changes what its whole directory holds
+		if (use_ignore_files && (change.filename() == ".gitignore" || change.filename() == ".ignore"))
+		{
+			change = change.parent_path();
+		}
+
+		const std::string prefix = relative_path(folder, change);
+
+		if (prefix.starts_with(".."))
+		{
+			continue;
+		}
+
+		std::error_code error;
+		const std::filesystem::directory_entry entry(change, error);
+		const bool is_directory = entry.is_directory(error) && !entry.is_symlink(error);
+
+		// Whatever the walk does not reach is left out, and so removed
+		const auto ignores = use_ignore_files ?
+			filter_below(folder, is_directory ? change : change.parent_path()) :
+			std::optional<std::shared_ptr<const ignore_filter>>(nullptr);
+
+		if (ignores && is_directory)
+		{
+			walk(change, *ignores, error, visit);
+		}
+		else if (ignores && !(*ignores && (*ignores)->is_ignored(entry)))
+		{
+			visit(entry);
+		}
+
+		// What the index holds below the change but is no longer there is gone
+		const indexed_file key = { prefix, 0, 0 };
+
+		for (auto iter = std::lower_bound(indexed.cbegin(), indexed.cend(), key);
+			iter != indexed.cend() && iter->path.starts_with(prefix);
+			++iter)
+		{
+			const bool below = prefix.empty() || iter->path.size() == prefix.size() || iter->path[prefix.size()] == '/';
+
+			if (below && !present.contains(std::string(iter->path)))
+			{
+				deleted.emplace(iter->path);
+			}
+		}
+	}
+
+	std::sort(modified.begin(), modified.end());
+	modified.erase(std::unique(modified.begin(), modified.end()), modified.end());
+
+	if (modified.empty() && deleted.empty())
+	{
+		return;
+	}
+
+	thread_pool pool(thread_count);
+	const std::vector<std::vector<uint32_t>> trigrams = extract_all(pool, modified);
+	index_writer writer;
+
+	for (size_t i = 0; i < modified.size(); ++i)
+	{
+		std::error_code error;
+		const uint32_t id = writer.add_file(
+			relative_path(folder, modified[i].path()),
+			modified[i].file_size(error),
+			modified_time(modified[i]),
+			0);
+
+		writer.add_trigrams(id, trigrams[i]);
+	}
+
+	for (const std::string& path : deleted)
+	{
+		writer.add_file(path, 0, 0, deleted_flag);
+	}
+
+	const size_t number = index._segments.size();
+	const segment_view base(index._segments.front()->data());
+	writer.write(segment_path(folder, number), base.header().generation);
+
+	std::cout << "Updated " << modified.size() << " files, removed " << deleted.size() << " files." << std::endl;
+
+	if (number >= max_segments)
+	{
+		compact(folder);
+	}
+}
+
+trigram_index::trigram_index(const std::filesystem::path& folder) :
+	_folder(folder)
+{
+	auto base = std::make_unique<memory_mapped_file>(default_path(folder));
+
+	if (!is_valid_segment(base->data()))
+	{
+		throw std::runtime_error("invalid index");
+	}
+
+	const uint64_t generation = segment_view(base->data()).header().generation;
+	_segments.emplace_back(std::move(base));
+
+	// The segments are numbered from one without gaps, those left over from
+	// another base end the sequence
+	for (size_t number = 1; ; ++number)
+	{
+		std::unique_ptr<memory_mapped_file> segment;
+
+		try
+		{
+			segment = std::make_unique<memory_mapped_file>(segment_path(folder, number));
+		}
+		catch (const std::exception&)
+		{
+			break;
+		}
+
+		if (!is_valid_segment(segment->data()) ||
+			segment_view(segment->data()).header().generation != generation)
+		{
+			break;
+		}
+
+		_segments.emplace_back(std::move(segment));
+	}
+}
+
+trigram_index::~trigram_index()
+{
+}
+
+std::vector<std::filesystem::path> trigram_index::candidates(std::string_view literal) const
+{
+	const std::vector<uint32_t> trigrams = literal_trigrams(literal);
+	std::vector<std::vector<std::filesystem::path>> found(_segments.size());
+
+	// Only the paths of the segments newer than the one at hand can shadow
+	// its files, the base itself is never added
+	std::unordered_set<std::string_view> shadowed;
+
+	for (size_t i = _segments.size(); i-- > 0;)
+	{
+		const segment_view segment(_segments[i]->data());
+
+		for (uint32_t id : segment.candidates(trigrams))
+		{
+			if (!(segment.file(id).flags & deleted_flag) && !shadowed.contains(segment.path(id)))
+			{
+				found[i].emplace_back(_folder / std::filesystem::path(segment.path(id)));
+			}
+		}
+
+		for (uint32_t id = 0; i && id < segment.header().file_count; ++id)
+		{
+			shadowed.insert(segment.path(id));
+		}
+	}
+
+	std::vector<std::filesystem::path> result;
+
+	for (auto& paths : found)
+	{
+		std::move(paths.begin(), paths.end(), std::back_inserter(result));
+	}
+
+	return result;
+}
+
+std::vector<std::filesystem::path> trigram_index::candidates(
+	std::string_view literal,
+	const std::vector<std::filesystem::path>& files) const
+{
+	const std::vector<uint32_t> trigrams = literal_trigrams(literal);
+	const std::vector<std::vector<bool>> live = live_files();
+
+	struct indexed_file
+	{
+		const file_entry* entry = nullptr;
+		bool candidate = false;
+	};
+
+	// The current state of every file in the index, by its path
+	std::unordered_map<std::string_view, indexed_file> indexed;
+
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		const segment_view segment(_segments[i]->data());
+
+		for (uint32_t id = 0; id < segment.header().file_count; ++id)
+		{
+			if (live[i][id])
+			{
+				indexed[segment.path(id)].entry = &segment.file(id);
+			}
+		}
+
+		for (uint32_t id : segment.candidates(trigrams))
+		{
+			if (live[i][id])
+			{
+				indexed[segment.path(id)].candidate = true;
+			}
+		}
+	}
+
+	std::vector<std::filesystem::path> result;
+
+	for (const auto& file : files)
+	{
+		const auto iter = indexed.find(relative_path(_folder, file));
+
+		if (iter == indexed.cend() || iter->second.candidate)
+		{
+			result.push_back(file);
+			continue;
+		}
+
+		// Changed since, the file is taken as the update would find it
+		std::error_code error;
+		const std::filesystem::directory_entry entry(file, error);
+
+		if (error || entry.file_size(error) != iter->second.entry->size || modified_time(entry) != iter->second.entry->modified)
+		{
+			result.push_back(file);
+		}
+	}
+
+	return result;
+}
+
+void trigram_index::compact(const std::filesystem::path& folder)
+{
+	const trigram_index index(folder);
+	const std::vector<std::vector<bool>> live = index.live_files();
+
+	// The live files keep their order, the base first, so merging the posting
+	// lists of the segments in order keeps them sorted
+	index_writer writer;
+	std::vector<std::vector<uint32_t>> renumbered(index._segments.size());
+
+	for (size_t i = 0; i < index._segments.size(); ++i)
+	{
+		const segment_view segment(index._segments[i]->data());
+		renumbered[i].assign(segment.header().file_count, UINT32_MAX);
+
+		for (uint32_t id = 0; id < segment.header().file_count; ++id)
+		{
+			if (live[i][id])
+			{
+				const file_entry& file = segment.file(id);
+				renumbered[i][id] = writer.add_file(segment.path(id), file.size, file.modified, 0);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < index._segments.size(); ++i)
+	{
+		segment_view(index._segments[i]->data()).for_each_posting_list([&](uint32_t trigram, const std::vector<uint32_t>& ids)
+		{
+			for (uint32_t id : ids)
+			{
+				if (renumbered[i][id] != UINT32_MAX)
+				{
+					writer.add_posting(trigram, renumbered[i][id]);
+				}
+			}
+		});
+	}
+
+	writer.write(default_path(folder), new_generation());
+	remove_segments(folder);
+
+	std::cout << "Compacted " << index._segments.size() - 1 << " segments, "
+		<< writer.file_count() << " files, " << writer.trigram_count() << " trigrams." << std::endl;
+}
+
+std::vector<std::vector<bool>> trigram_index::live_files() const
+{
+	std::vector<std::vector<bool>> live(_segments.size());
+	std::unordered_set<std::string_view> shadowed;
+
+	for (size_t i = _segments.size(); i-- > 0;)
+	{
+		const segment_view segment(_segments[i]->data());
+		live[i].resize(segment.header().file_count);
+
+		for (uint32_t id = 0; id < segment.header().file_count; ++id)
+		{
+			live[i][id] = !(segment.file(id).flags & deleted_flag) && !shadowed.contains(segment.path(id));
+		}
+
+		for (uint32_t id = 0; i && id < segment.header().file_count; ++id)
+		{
+			shadowed.insert(segment.path(id));
+		}
+	}
+
+	return live;
+}
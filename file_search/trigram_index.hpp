@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class memory_mapped_file;
+
+// An on-disk index of the case folded trigrams each file of a folder contains.
+// The file is memory mapped as is: a header, a table of the files, a sorted
+// table of the trigrams and the posting list of each trigram, which is the
+// delta and varint encoded ids of the files containing it. A compressed file
+// is indexed by its decompressed text and a UTF-16 one by its UTF-8, which is
+// what a search looks at.
+//
+// Updates do not rewrite the index. They are appended as numbered segments of
+// the same format, whose files shadow the same files of the base and of the
+// older segments and which record deleted files as well. Once there are
+// enough of them the segments are merged back into the base.
+class trigram_index
+{
+public:
+	// The index of a folder lives in the folder itself
+	static std::filesystem::path default_path(const std::filesystem::path& folder);
+
+	// Whether the file is the index, one of its segments or one being written
+	static bool is_index_file(const std::filesystem::path& path);
+
+	// Indexes every regular file under the folder a search walks, which skips
+	// the files the ignore files exclude if they are used
+	static void build(const std::filesystem::path& folder, bool use_ignore_files, size_t thread_count);
+
+	// Reindexes the files created, modified or deleted under the changed
+	// paths, a directory standing for everything below it, into a new
+	// segment. A change to an ignore file stands for its directory, files it
+	// now excludes are removed.
+	static void update(
+		const std::filesystem::path& folder,
+		const std::vector<std::filesystem::path>& changes,
+		bool use_ignore_files,
+		size_t thread_count);
+
+	explicit trigram_index(const std::filesystem::path& folder);
+	~trigram_index();
+
+	// The files which may contain the literal, ignoring the case. A literal
+	// shorter than a trigram narrows nothing down, every file is a candidate.
+	std::vector<std::filesystem::path> candidates(std::string_view literal) const;
+
+	// Of the files, in their order, those the index lists as candidates and
+	// those it does not hold as they are: created since it was written, or
+	// with another size or modification time. The index need not be up to
+	// date to miss nothing, the files it holds that are not candidates take
+	// a stat each.
+	std::vector<std::filesystem::path> candidates(
+		std::string_view literal,
+		const std::vector<std::filesystem::path>& files) const;
+
+private:
+	trigram_index(const trigram_index&) = delete;
+	trigram_index(trigram_index&&) = delete;
+	trigram_index& operator = (const trigram_index&) = delete;
+	trigram_index& operator = (trigram_index&&) = delete;
+
+	// Merges every segment into a new base
+	static void compact(const std::filesystem::path& folder);
+
+	// Whether each file of each segment is the current state of the file
+	std::vector<std::vector<bool>> live_files() const;
+
+	std::filesystem::path _folder;
+
+	// The base first, then the segments from the oldest to the newest
+	std::vector<std::unique_ptr<memory_mapped_file>> _segments;
+};
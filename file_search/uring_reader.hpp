@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Reads whole small files through an io_uring, many of them in flight at once.
+// Each file is opened, read and closed by three linked requests into a slot of
+// the ring's own file table, so the descriptor never comes back to user space
+// and a whole batch of files costs a single system call.
+//
+// A file that does not fit the buffer of its slot, or fails to be read for any
+// reason, is reported as incomplete and left to the caller's usual path.
+class uring_reader
+{
+public:
+	struct result
+	{
+		// Whether the contents are the whole file
+		bool complete = false;
+		std::string_view contents;
+	};
+
+	// Throws if the kernel cannot do it
+	uring_reader(unsigned queue_depth, size_t buffer_size);
+	~uring_reader();
+
+	// Every slot has a read queued or a result not released yet
+	bool full() const;
+
+	// Files of this size or larger never come out complete
+	size_t buffer_size() const;
+
+	// Queues the reading of the file into a free slot and returns the slot.
+	// The requests are submitted by the next wait.
+	unsigned read(const std::filesystem::path& path);
+
+	// Submits what is queued and waits for the read in the slot. The contents
+	// are valid until the slot is released.
+	result wait(unsigned slot);
+
+	void release(unsigned slot);
+
+private:
+	uring_reader(const uring_reader&) = delete;
+	uring_reader(uring_reader&&) = delete;
+	uring_reader& operator = (const uring_reader&) = delete;
+	uring_reader& operator = (uring_reader&&) = delete;
+
+	struct slot_state
+	{
+		std::string path;
+		bool busy = false;
+
+		// The completions seen out of the three requests
+		unsigned completions = 0;
+		int open_result = 0;
+		int read_result = 0;
+	};
+
+	// Takes in whatever completions have arrived
+	void reap();
+
+	class ring;
+
+	std::unique_ptr<ring> _ring;
+	const size_t _buffer_size;
+	std::vector<char> _buffers;
+	std::vector<slot_state> _slots;
+	std::vector<unsigned> _free_slots;
+	unsigned _queued = 0;
+};
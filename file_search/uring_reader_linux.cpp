@@ -0,0 +1,327 @@
+#include "uring_reader.hpp"
+
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+	// The three requests of a slot, told apart in the user data
+	enum request : uint64_t
+	{
+		open_request,
+		read_request,
+		close_request
+	};
+
+	uint64_t user_data(unsigned slot, request kind)
+	{
+		return static_cast<uint64_t>(slot) << 2 | kind;
+	}
+
+	void* map_ring(int fd, size_t size, off_t offset)
+	{
+		void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+		if (address == MAP_FAILED)
+		{
+			throw std::system_error(errno, std::system_category(), "mmap of the ring failed");
+		}
+
+		return address;
+	}
+}
+
+// The submission and completion queues shared with the kernel, driven through
+// the bare system calls
+class uring_reader::ring
+{
+public:
+	explicit ring(unsigned entries)
+	{
+		io_uring_params params = {};
+
+		// Older kernels lack the direct descriptors the requests rely on and
+		// refuse the flag as well
+		params.flags = IORING_SETUP_SUBMIT_ALL;
+
+		_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+		if (_fd == -1)
+		{
+			throw std::system_error(errno, std::system_category(), "io_uring_setup failed");
+		}
+
+		try
+		{
+			_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+			{
+				_sq_size = _cq_size = std::max(_sq_size, _cq_size);
+			}
+
+			_sq = static_cast<char*>(map_ring(_fd, _sq_size, IORING_OFF_SQ_RING));
+			_cq = (params.features & IORING_FEAT_SINGLE_MMAP) ?
+				_sq :
+				static_cast<char*>(map_ring(_fd, _cq_size, IORING_OFF_CQ_RING));
+
+			_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			_sqes = static_cast<io_uring_sqe*>(map_ring(_fd, _sqes_size, IORING_OFF_SQES));
+		}
+		catch (...)
+		{
+			unmap();
+			throw;
+		}
+
+		_sq_tail = reinterpret_cast<unsigned*>(_sq + params.sq_off.tail);
+		_sq_mask = *reinterpret_cast<unsigned*>(_sq + params.sq_off.ring_mask);
+		_sq_array = reinterpret_cast<unsigned*>(_sq + params.sq_off.array);
+		_cq_head = reinterpret_cast<unsigned*>(_cq + params.cq_off.head);
+		_cq_tail = reinterpret_cast<unsigned*>(_cq + params.cq_off.tail);
+		_cq_mask = *reinterpret_cast<unsigned*>(_cq + params.cq_off.ring_mask);
+		_cqes = reinterpret_cast<io_uring_cqe*>(_cq + params.cq_off.cqes);
+
+		_tail = *_sq_tail;
+	}
+
+	~ring()
+	{
+		unmap();
+	}
+
+	// A zeroed entry at the tail, which the caller makes sure is free
+	io_uring_sqe& next_entry()
+	{
+		const unsigned index = _tail++ & _sq_mask;
+		_sq_array[index] = index;
+
+		io_uring_sqe& entry = _sqes[index];
+		std::memset(&entry, 0, sizeof(entry));
+		return entry;
+	}
+
+	// Hands the entries over to the kernel and waits for the number of
+	// completions, returns the number of entries submitted
+	unsigned enter(unsigned to_submit, unsigned min_complete)
+	{
+		std::atomic_ref<unsigned>(*_sq_tail).store(_tail, std::memory_order_release);
+
+		for (;;)
+		{
+			const long result = syscall(__NR_io_uring_enter, _fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+			if (result >= 0)
+			{
+				return static_cast<unsigned>(result);
+			}
+
+			if (errno != EINTR)
+			{
+				throw std::system_error(errno, std::system_category(), "io_uring_enter failed");
+			}
+		}
+	}
+
+	void register_files(unsigned count)
+	{
+		const std::vector<int> sparse(count, -1);
+
+		if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES, sparse.data(), count) == -1)
+		{
+			throw std::system_error(errno, std::system_category(), "io_uring_register failed");
+		}
+	}
+
+	template <typename F>
+	void for_each_completion(F&& callback)
+	{
+		unsigned head = *_cq_head;
+		const unsigned tail = std::atomic_ref<unsigned>(*_cq_tail).load(std::memory_order_acquire);
+
+		for (; head != tail; ++head)
+		{
+			callback(_cqes[head & _cq_mask]);
+		}
+
+		std::atomic_ref<unsigned>(*_cq_head).store(head, std::memory_order_release);
+	}
+
+private:
+	void unmap()
+	{
+		if (_sqes)
+		{
+			munmap(_sqes, _sqes_size);
+		}
+
+		if (_cq && _cq != _sq)
+		{
+			munmap(_cq, _cq_size);
+		}
+
+		if (_sq)
+		{
+			munmap(_sq, _sq_size);
+		}
+
+		close(_fd);
+	}
+
+	int _fd = -1;
+
+	char* _sq = nullptr;
+	char* _cq = nullptr;
+	io_uring_sqe* _sqes = nullptr;
+	size_t _sq_size = 0;
+	size_t _cq_size = 0;
+	size_t _sqes_size = 0;
+
+	unsigned* _sq_tail = nullptr;
+	unsigned _sq_mask = 0;
+	unsigned* _sq_array = nullptr;
+	unsigned* _cq_head = nullptr;
+	unsigned* _cq_tail = nullptr;
+	unsigned _cq_mask = 0;
+	io_uring_cqe* _cqes = nullptr;
+
+	// The tail as far as entries were filled in, published on entering
+	unsigned _tail = 0;
+};
+
+uring_reader::uring_reader(unsigned queue_depth, size_t buffer_size) :
+	_ring(std::make_unique<ring>(queue_depth * 3)),
+	_buffer_size(buffer_size),
+	_buffers(queue_depth * buffer_size),
+	_slots(queue_depth)
+{
+	// A slot of the file table per slot of the reader
+	_ring->register_files(queue_depth);
+
+	for (unsigned slot = queue_depth; slot > 0; --slot)
+	{
+		_free_slots.push_back(slot - 1);
+	}
+}
+
+uring_reader::~uring_reader()
+{
+	// The kernel must be done with the buffers before they go away
+	try
+	{
+		for (unsigned slot = 0; slot < _slots.size(); ++slot)
+		{
+			if (_slots[slot].busy)
+			{
+				wait(slot);
+			}
+		}
+	}
+	catch (const std::exception&)
+	{
+	}
+}
+
+bool uring_reader::full() const
+{
+	return _free_slots.empty();
+}
+
+size_t uring_reader::buffer_size() const
+{
+	return _buffer_size;
+}
+
+unsigned uring_reader::read(const std::filesystem::path& path)
+{
+	const unsigned slot = _free_slots.back();
+	_free_slots.pop_back();
+
+	slot_state& state = _slots[slot];
+	state.path = path.native();
+	state.busy = true;
+	state.completions = 0;
+
+	io_uring_sqe& open_entry = _ring->next_entry();
+	open_entry.opcode = IORING_OP_OPENAT;
+	open_entry.flags = IOSQE_IO_LINK;
+	open_entry.fd = AT_FDCWD;
+	open_entry.addr = reinterpret_cast<uint64_t>(state.path.c_str());
+	open_entry.open_flags = O_RDONLY; // A direct descriptor refuses O_CLOEXEC
+	open_entry.file_index = slot + 1;
+	open_entry.user_data = user_data(slot, open_request);
+
+	// A short read breaks an ordinary link, the close must run regardless
+	io_uring_sqe& read_entry = _ring->next_entry();
+	read_entry.opcode = IORING_OP_READ;
+	read_entry.flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+	read_entry.fd = static_cast<int>(slot);
+	read_entry.addr = reinterpret_cast<uint64_t>(_buffers.data() + slot * _buffer_size);
+	read_entry.len = static_cast<uint32_t>(_buffer_size);
+	read_entry.user_data = user_data(slot, read_request);
+
+	io_uring_sqe& close_entry = _ring->next_entry();
+	close_entry.opcode = IORING_OP_CLOSE;
+	close_entry.file_index = slot + 1;
+	close_entry.user_data = user_data(slot, close_request);
+
+	_queued += 3;
+	return slot;
+}
+
+uring_reader::result uring_reader::wait(unsigned slot)
+{
+	slot_state& state = _slots[slot];
+
+	while (state.completions < 3)
+	{
+		_queued -= _ring->enter(_queued, 1);
+		reap();
+	}
+
+	// A file filling the whole buffer may well go on past it
+	if (state.open_result < 0 || state.read_result < 0 || static_cast<size_t>(state.read_result) >= _buffer_size)
+	{
+		return {};
+	}
+
+	return { true, std::string_view(_buffers.data() + slot * _buffer_size, static_cast<size_t>(state.read_result)) };
+}
+
+void uring_reader::release(unsigned slot)
+{
+	_slots[slot].busy = false;
+	_free_slots.push_back(slot);
+}
+
+void uring_reader::reap()
+{
+	_ring->for_each_completion([this](const io_uring_cqe& completion)
+	{
+		slot_state& state = _slots[completion.user_data >> 2];
+
+		switch (completion.user_data & 3)
+		{
+		case open_request:
+			state.open_result = completion.res;
+			break;
+
+		case read_request:
+			state.read_result = completion.res;
+			break;
+		}
+
+		++state.completions;
+	});
+}
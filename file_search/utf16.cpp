@@ -0,0 +1,217 @@
+#include "utf16.hpp"
+
+namespace
+{
+	char16_t unit_at(std::string_view units, size_t offset)
+	{
+		return static_cast<char16_t>(static_cast<uint8_t>(units[offset]) | static_cast<uint8_t>(units[offset + 1]) << 8);
+	}
+
+	void append_unit(std::string& units, uint32_t unit)
+	{
+		units += static_cast<char>(unit & 0xFF);
+		units += static_cast<char>(unit >> 8);
+	}
+
+	void append_utf8(std::string& text, uint32_t code_point)
+	{
+		if (code_point < 0x80)
+		{
+			text += static_cast<char>(code_point);
+		}
+		else if (code_point < 0x800)
+		{
+			text += static_cast<char>(0xC0 | code_point >> 6);
+			text += static_cast<char>(0x80 | (code_point & 0x3F));
+		}
+		else if (code_point < 0x10000)
+		{
+			text += static_cast<char>(0xE0 | code_point >> 12);
+			text += static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+			text += static_cast<char>(0x80 | (code_point & 0x3F));
+		}
+		else
+		{
+			text += static_cast<char>(0xF0 | code_point >> 18);
+			text += static_cast<char>(0x80 | (code_point >> 12 & 0x3F));
+			text += static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+			text += static_cast<char>(0x80 | (code_point & 0x3F));
+		}
+	}
+
+	char16_t fold_case(char16_t unit)
+	{
+		return unit >= 'A' && unit <= 'Z' ? static_cast<char16_t>(unit | 0x20) : unit;
+	}
+
+	constexpr uint32_t replacement_character = 0xFFFD;
+}
+
+std::optional<std::string> utf8_to_utf16(std::string_view text)
+{
+	std::string units;
+	units.reserve(text.size() * 2);
+
+	for (size_t i = 0; i < text.size();)
+	{
+		const uint8_t lead = static_cast<uint8_t>(text[i]);
+		size_t length = 0;
+		uint32_t code_point = 0;
+
+		if (lead < 0x80)
+		{
+			length = 1;
+			code_point = lead;
+		}
+		else if (lead >= 0xC2 && lead <= 0xDF)
+		{
+			length = 2;
+			code_point = lead & 0x1F;
+		}
+		else if (lead >= 0xE0 && lead <= 0xEF)
+		{
+			length = 3;
+			code_point = lead & 0x0F;
+		}
+		else if (lead >= 0xF0 && lead <= 0xF4)
+		{
+			length = 4;
+			code_point = lead & 0x07;
+		}
+		else
+		{
+			return {};
+		}
+
+		if (text.size() - i < length)
+		{
+			return {};
+		}
+
+		for (size_t j = 1; j < length; ++j)
+		{
+			const uint8_t trail = static_cast<uint8_t>(text[i + j]);
+
+			if ((trail & 0xC0) != 0x80)
+			{
+				return {};
+			}
+
+			code_point = code_point << 6 | (trail & 0x3F);
+		}
+
+		// Overlong forms, surrogates and what is beyond Unicode
+		static constexpr uint32_t min_code_point[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+		if (code_point < min_code_point[length] || (code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF)
+		{
+			return {};
+		}
+
+		if (code_point < 0x10000)
+		{
+			append_unit(units, code_point);
+		}
+		else
+		{
+			code_point -= 0x10000;
+			append_unit(units, 0xD800 | code_point >> 10);
+			append_unit(units, 0xDC00 | (code_point & 0x3FF));
+		}
+
+		i += length;
+	}
+
+	return units;
+}
+
+std::string utf16_to_utf8(std::string_view units)
+{
+	std::string text;
+	text.reserve(units.size());
+
+	size_t i = 0;
+
+	for (; i + 1 < units.size(); i += 2)
+	{
+		const char16_t unit = unit_at(units, i);
+
+		if (unit < 0xD800 || unit > 0xDFFF)
+		{
+			append_utf8(text, unit);
+		}
+		else if (unit <= 0xDBFF && i + 3 < units.size() && unit_at(units, i + 2) >= 0xDC00 && unit_at(units, i + 2) <= 0xDFFF)
+		{
+			append_utf8(text, 0x10000 + ((unit & 0x3FFu) << 10 | (unit_at(units, i + 2) & 0x3FFu)));
+			i += 2;
+		}
+		else
+		{
+			append_utf8(text, replacement_character);
+		}
+	}
+
+	if (i < units.size())
+	{
+		append_utf8(text, replacement_character);
+	}
+
+	return text;
+}
+
+bool utf16_equal_ignoring_case(std::string_view units, std::string_view other)
+{
+	if (units.size() != other.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i + 1 < units.size(); i += 2)
+	{
+		if (fold_case(unit_at(units, i)) != fold_case(unit_at(other, i)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t utf16_line_end(std::string_view units, size_t offset)
+{
+	for (size_t i = offset; i + 1 < units.size(); i += 2)
+	{
+		if (units[i] == '\n' && !units[i + 1])
+		{
+			return i;
+		}
+	}
+
+	return units.size();
+}
+
+size_t utf16_line_begin(std::string_view units, size_t offset)
+{
+	for (size_t i = offset; i >= 2; i -= 2)
+	{
+		if (units[i - 2] == '\n' && !units[i - 1])
+		{
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t utf16_count_lines(std::string_view units, size_t begin, size_t end)
+{
+	uint64_t count = 0;
+
+	// A line feed is a whole unit, the loop is left for the compiler to widen
+	for (size_t i = begin; i + 1 < end; i += 2)
+	{
+		count += unit_at(units, i) == u'\n';
+	}
+
+	return count;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// UTF-16LE text taken as it is, two bytes to a code unit. Offsets are in
+// bytes; a code unit starts at an even one, counting from the start of the
+// text passed in.
+
+// The UTF-16LE code units of UTF-8 text, none if it is not valid UTF-8
+std::optional<std::string> utf8_to_utf16(std::string_view text);
+
+// The UTF-8 of UTF-16LE code units, an unpaired surrogate or a dangling byte
+// becoming U+FFFD
+std::string utf16_to_utf8(std::string_view units);
+
+// Whether the code units are the same but for the case of ASCII letters
+bool utf16_equal_ignoring_case(std::string_view units, std::string_view other);
+
+// The offset of the line feed ending the line with the unit at the offset, or
+// the size of the text if it is the last line
+size_t utf16_line_end(std::string_view units, size_t offset);
+
+// The offset of the first unit of the line with the unit at the offset
+size_t utf16_line_begin(std::string_view units, size_t offset);
+
+// The line feeds between the offsets, which must be even
+uint64_t utf16_count_lines(std::string_view units, size_t begin, size_t end);
@@ -3,12 +3,20 @@
 #include <atomic>
 #include <filesystem>
 #include <functional>
+#include <vector>
 
 class file_watcher
 {
 public:
 	explicit file_watcher(const std::filesystem::path& path);
 	void start(const std::function<void()>& callback);
+
+#if defined(__linux__)
+	// Watches every directory below the path as well and reports the paths
+	// created, modified, moved or deleted, a batch at a time once the events
+	// settle down. A reported directory may have changed anywhere below it.
+	void watch_tree(const std::function<void(const std::vector<std::filesystem::path>&)>& callback);
+#endif
 	void stop();
 
 private:
@@ -5,15 +5,19 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <set>
 #include <system_error>
 #include <iostream>
+#include <unordered_map>
 
 using millisecond = std::chrono::duration<int, std::ratio<1, 1000>>;
 
 class notification_descriptor
 {
 public:
-	notification_descriptor(const std::filesystem::path& path)//  :
+	notification_descriptor(const std::filesystem::path& path, uint32_t mask = IN_CREATE | IN_DELETE) :
+		_root(path),
+		_mask(mask)
 	{
 		_inotify = inotify_init1(IN_NONBLOCK);
 
@@ -22,17 +26,29 @@ public:
 			throw std::system_error(errno, std::system_category(), "inotify_init1 failed");
 		}
 
-		_watch = inotify_add_watch(_inotify, path.c_str(), IN_CREATE | IN_DELETE);
-
-		if (_watch == -1)
+		if (!add_watch(path))
 		{
 			throw std::system_error(errno, std::system_category(), "inotify_add_watch failed");
 		}
 	}
 
+	// Watching a directory again, as after it moved, only updates its path
+	bool add_watch(const std::filesystem::path& path)
+	{
+		const int watch = inotify_add_watch(_inotify, path.c_str(), _mask);
+
+		if (watch == -1)
+		{
+			return false;
+		}
+
+		_watches[watch] = path;
+		return true;
+	}
+
 	bool is_valid() const
 	{
-		return _inotify != -1 && _watch != -1;
+		return _inotify != -1 && !_watches.empty();
 	}
 
 	short wait(millisecond timeout)
@@ -45,27 +61,71 @@ public:
 
 		if (poll_result == -1)
 		{
-			throw std::system_error(poll_result, std::system_category(), "poll failed");
+			// A signal, which may be the one to stop
+			if (errno == EINTR)
+			{
+				return 0;
+			}
+
+			throw std::system_error(errno, std::system_category(), "poll failed");
 		}
 
 		return poll_inotify.revents;
 	}
 
+	// Calls back with the watched directory and each pending event. A queue
+	// overflow, which loses events, is reported against the root.
+	template <typename F>
+	void read_events(F&& callback)
+	{
+		alignas(inotify_event) char buffer[0x1000];
+
+		for (;;)
+		{
+			const ssize_t size = read(_inotify, buffer, sizeof(buffer));
+
+			if (size <= 0)
+			{
+				return;
+			}
+
+			for (ssize_t offset = 0; offset < size;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					callback(_root, *event);
+					continue;
+				}
+
+				const auto iter = _watches.find(event->wd);
+
+				if (iter == _watches.end())
+				{
+					continue;
+				}
+
+				if (event->mask & IN_IGNORED)
+				{
+					_watches.erase(iter);
+					continue;
+				}
+
+				callback(iter->second, *event);
+			}
+		}
+	}
+
 	void refresh()
 	{
-		char buffer[0xFF] = {};
-		read(_inotify, buffer, 0xFF);
-		// TODO: make something usefull with the buffer
+		read_events([](const std::filesystem::path&, const inotify_event&) {});
 	}
 
 	~notification_descriptor()
 	{
-		if (_watch != -1 && inotify_rm_watch(_inotify, _watch) == -1)
-		{
-			std::cerr << "inotify_rm_watch failed: 0x"
-				<< std::hex << errno << std::endl;
-		}
-
+		// Closing the descriptor removes every watch
 		if (_inotify != -1 && close(_inotify) == -1)
 		{
 			std::cerr << "close failed: 0x"
@@ -74,8 +134,10 @@ public:
 	}
 
 private:
+	const std::filesystem::path _root;
+	const uint32_t _mask;
 	int _inotify = -1;
-	int _watch = -1;
+	std::unordered_map<int, std::filesystem::path> _watches;
 };
 
 file_watcher::file_watcher(const std::filesystem::path& path) :
@@ -109,6 +171,80 @@ void file_watcher::start(const std::function<void()>& callback)
 	}
 }
 
+void file_watcher::watch_tree(const std::function<void(const std::vector<std::filesystem::path>&)>& callback)
+{
+	constexpr uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO;
+	constexpr millisecond settle_time(200);
+	constexpr millisecond max_batch_time(2000);
+
+	notification_descriptor notification(_path, mask);
+
+	const auto watch_below = [&](const std::filesystem::path& path)
+	{
+		std::error_code error;
+		const auto options = std::filesystem::directory_options::skip_permission_denied;
+
+		for (std::filesystem::recursive_directory_iterator iter(path, options, error), end; !error && iter != end; iter.increment(error))
+		{
+			if (iter->is_directory(error) && !iter->is_symlink(error))
+			{
+				notification.add_watch(iter->path());
+			}
+		}
+	};
+
+	watch_below(_path);
+
+	std::set<std::filesystem::path> changes;
+
+	const auto collect = [&](const std::filesystem::path& directory, const inotify_event& event)
+	{
+		if (!event.len)
+		{
+			changes.insert(directory);
+			return;
+		}
+
+		const std::filesystem::path path = directory / event.name;
+
+		// Whatever lands in a new directory before it is watched is covered by
+		// reporting the directory itself
+		if ((event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO)))
+		{
+			notification.add_watch(path);
+			watch_below(path);
+		}
+
+		changes.insert(path);
+	};
+
+	while (_run)
+	{
+		short result = notification.wait(millisecond(1000));
+
+		if (result < 0)
+		{
+			return;
+		}
+
+		if (!(result & POLLIN))
+		{
+			continue;
+		}
+
+		const auto deadline = std::chrono::steady_clock::now() + max_batch_time;
+
+		do
+		{
+			notification.read_events(collect);
+		}
+		while (_run && std::chrono::steady_clock::now() < deadline && (notification.wait(settle_time) & POLLIN));
+
+		callback(std::vector<std::filesystem::path>(changes.cbegin(), changes.cend()));
+		changes.clear();
+	}
+}
+
 void file_watcher::stop()
 {
 	_run = false;